@@ -0,0 +1,13 @@
+# Benchmarks of the Buttons plugin, see main.cpp.
+JSONFILES = ../devicepluginbuttons.json
+
+include(../../common/benchmark/benchmark.pri)
+
+TARGET = buttons-benchmark
+
+SOURCES += \
+    main.cpp \
+    dispatchbenchmark.cpp \
+
+HEADERS += \
+    dispatchbenchmark.h \
@@ -0,0 +1,120 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "dispatchbenchmark.h"
+#include "plugintables.h"
+
+// Calls per sample, a single dispatch is too short for the clock
+static const int batchSize = 1000;
+
+// Has the action handlers of the Buttons plugin, they only count their calls
+class DispatchTarget
+{
+public:
+    DispatchTarget() : calls(0) { }
+    int calls;
+
+    typedef DeviceManager::DeviceError (DispatchTarget::*Handler)(Device *device, const Action &action);
+
+    // The if-chain of DevicePluginButtons::executeAction before the dispatch table
+    static Handler chainHandler(const DeviceClassId &deviceClassId, const ActionTypeId &actionTypeId)
+    {
+        if (deviceClassId == simpleButtonDeviceClassId) {
+            if (actionTypeId == pressSimpleButtonActionTypeId)
+                return &DispatchTarget::executePressSimpleButton;
+
+            return 0;
+        }
+
+        if (deviceClassId == powerButtonDeviceClassId) {
+            if (actionTypeId == setPowerButtonActionTypeId)
+                return &DispatchTarget::executeSetPowerButton;
+
+            return 0;
+        }
+
+        if (deviceClassId == alternativePowerButtonDeviceClassId) {
+            if (actionTypeId == alternativePowerActionTypeId)
+                return &DispatchTarget::executeAlternativePower;
+
+            return 0;
+        }
+
+        return 0;
+    }
+
+private:
+    friend class ActionDispatch<DispatchTarget>;
+
+    DeviceManager::DeviceError executePressSimpleButton(Device *, const Action &) { calls++; return DeviceManager::DeviceErrorNoError; }
+    DeviceManager::DeviceError executeSetPowerButton(Device *, const Action &) { calls++; return DeviceManager::DeviceErrorNoError; }
+    DeviceManager::DeviceError executeAlternativePower(Device *, const Action &) { calls++; return DeviceManager::DeviceErrorNoError; }
+};
+
+struct DispatchKey {
+    DeviceClassId deviceClassId;
+    ActionTypeId actionTypeId;
+};
+
+// Dispatches the keys round robin, batchSize calls per sample. Unknown keys count as
+// handled if no handler was found.
+template <typename Lookup>
+static BenchmarkResult measureDispatch(const QString &name, const QList<DispatchKey> &keys, int iterations, Lookup lookup)
+{
+    DispatchTarget target;
+    Action action(pressSimpleButtonActionTypeId, DeviceId());
+    return BenchmarkResult::measure(name, iterations, [&](int) {
+        int handled = 0;
+        for (int i = 0; i < batchSize; i++) {
+            const DispatchKey &key = keys.at(i % keys.count());
+            DispatchTarget::Handler handler = lookup(key.deviceClassId, key.actionTypeId);
+            if (handler) {
+                (target.*handler)(0, action);
+                handled++;
+            } else if (key.deviceClassId.isNull()) {
+                handled++;
+            }
+        }
+        return handled == batchSize;
+    });
+}
+
+QList<BenchmarkResult> DispatchBenchmark::run(int iterations)
+{
+    DispatchKey first = { simpleButtonDeviceClassId, pressSimpleButtonActionTypeId };
+    DispatchKey last = { alternativePowerButtonDeviceClassId, alternativePowerActionTypeId };
+    DispatchKey unknown = { DeviceClassId(), ActionTypeId() };
+
+    QList<QPair<QString, QList<DispatchKey> > > mixes;
+    mixes << qMakePair(QString("first class"), QList<DispatchKey>() << first);
+    mixes << qMakePair(QString("last class"), QList<DispatchKey>() << last);
+    mixes << qMakePair(QString("mixed"), QList<DispatchKey>() << first << DispatchKey{ powerButtonDeviceClassId, setPowerButtonActionTypeId } << last << unknown);
+
+    QList<BenchmarkResult> results;
+    for (int i = 0; i < mixes.count(); i++) {
+        const QString &mix = mixes.at(i).first;
+        const QList<DispatchKey> &keys = mixes.at(i).second;
+
+        results << measureDispatch(QString("if-chain %1 x%2").arg(mix).arg(batchSize), keys, iterations, &DispatchTarget::chainHandler);
+        results << measureDispatch(QString("ActionDispatch %1 x%2").arg(mix).arg(batchSize), keys, iterations, &ActionDispatch<DispatchTarget>::handler);
+    }
+
+    return results;
+}
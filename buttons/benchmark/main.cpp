@@ -0,0 +1,64 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "plugininfo.h"
+#include "dispatchbenchmark.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+// Benchmarks of the Buttons plugin
+//
+//   buttons-benchmark [options] [dispatch]
+//
+// Prints p50/p99 latency, operations per second and allocations per operation.
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    application.setApplicationName("buttons-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the Buttons plugin.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("benchmarks", "The benchmarks to run: dispatch (default: all).");
+
+    QCommandLineOption iterationsOption("iterations", "Samples of the dispatch benchmarks.", "count", "1000");
+    parser.addOption(iterationsOption);
+    parser.process(application);
+
+    QStringList benchmarks = parser.positionalArguments();
+    if (benchmarks.isEmpty())
+        benchmarks << "dispatch";
+
+    QList<BenchmarkResult> results;
+    if (benchmarks.contains("dispatch"))
+        results << DispatchBenchmark::run(parser.value(iterationsOption).toInt());
+
+    QTextStream out(stdout);
+    out << BenchmarkResult::header() << endl;
+    foreach (const BenchmarkResult &result, results) {
+        out << result.toString() << endl;
+    }
+
+    out << endl;
+    out << "peak memory: " << AllocationCounter::peakMemory() / 1024 << " KiB" << endl;
+    return 0;
+}
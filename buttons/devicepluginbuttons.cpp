@@ -57,73 +57,66 @@ DeviceManager::DeviceSetupStatus DevicePluginButtons::setupDevice(Device *device
 
 /* This method will be called whenever a client or the RuleEngine want's to execute
  * an action on the given device.
+ *
+ * The generated ActionDispatch table (plugintables.h) maps the DeviceClassId and
+ * ActionTypeId to the execute<ActionType>() method of this plugin.
  */
 DeviceManager::DeviceError DevicePluginButtons::executeAction(Device *device, const Action &action)
 {
-    // Tutorial 2
-    // Check the DeviceClassId for "Simple Button"
-    if (device->deviceClassId() == simpleButtonDeviceClassId ) {
-
-        // check if this is the "press" action
-        if (action.actionTypeId() == pressSimpleButtonActionTypeId) {
-
-            qCDebug(dcButtons) << "Simple button" << device->paramValue("name").toString() << "was pressed";
+    ActionDispatch<DevicePluginButtons>::Handler handler = ActionDispatch<DevicePluginButtons>::handler(device->deviceClassId(), action.actionTypeId());
+    if (!handler) {
+        if (!ActionDispatch<DevicePluginButtons>::containsDeviceClass(device->deviceClassId()))
+            return DeviceManager::DeviceErrorDeviceClassNotFound;
 
-            // Emit the "button pressed" event
-            Event event(simpleButtonPressedEventTypeId, device->id());
-            emit emitEvent(event);
-
-            return DeviceManager::DeviceErrorNoError;
-        }
         return DeviceManager::DeviceErrorActionTypeNotFound;
     }
 
+    return (this->*handler)(device, action);
+}
 
-    // Tutorial 3
-    // Check the DeviceClassId for "Power Button"
-    if (device->deviceClassId() == powerButtonDeviceClassId ) {
-
-        // check if this is the "set power" action
-        if (action.actionTypeId() == setPowerButtonActionTypeId) {
-
-            // get the param value
-            Param powerParam = action.param("power");
-            bool power = powerParam.value().toBool();
+// Tutorial 2
+// The "press" action of the "Simple Button"
+DeviceManager::DeviceError DevicePluginButtons::executePressSimpleButton(Device *device, const Action &action)
+{
+    Q_UNUSED(action)
 
-            qCDebug(dcButtons) << "Power button" << device->paramValue("name").toString() << "set power to" << power;
+    qCDebug(dcButtons) << "Simple button" << SimpleButtonDeviceParams::fromDevice(device).name << "was pressed";
 
-            // Set the "power" state
-            device->setStateValue(powerStateTypeId, power);
+    // Emit the "button pressed" event
+    Event event(simpleButtonPressedEventTypeId, device->id());
+    emit emitEvent(event);
 
-            return DeviceManager::DeviceErrorNoError;
-        }
-        return DeviceManager::DeviceErrorActionTypeNotFound;
-    }
+    return DeviceManager::DeviceErrorNoError;
+}
 
+// Tutorial 3
+// The "set power" action of the "Power Button"
+DeviceManager::DeviceError DevicePluginButtons::executeSetPowerButton(Device *device, const Action &action)
+{
+    // get the param value, the generated SetPowerButtonParams struct has a typed member for each param
+    bool power = SetPowerButtonParams::fromAction(action).power;
 
-    // Tutorial 4
-    // Check the DeviceClassId for "Alternative Power Button"
-    if (device->deviceClassId() == alternativePowerButtonDeviceClassId) {
+    qCDebug(dcButtons) << "Power button" << PowerButtonDeviceParams::fromDevice(device).name << "set power to" << power;
 
-        // check if this is the "set power" action
-        if (action.actionTypeId() == alternativePowerActionTypeId) {
+    // Set the "power" state
+    device->setStateValue(powerStateTypeId, power);
 
-            // get the param value
-            Param powerParam = action.param("power");
-            bool power = powerParam.value().toBool();
+    return DeviceManager::DeviceErrorNoError;
+}
 
-            qCDebug(dcButtons) << "Alternative power button" << device->paramValue("name").toString() << "set power to" << power;
-            qCDebug(dcButtons) << "ActionTypeId :" << action.actionTypeId().toString();
-            qCDebug(dcButtons) << "StateTypeId  :" << alternativePowerStateTypeId.toString();
+// Tutorial 4
+// The "set power" action of the "Alternative Power Button", generated from the writable "power" state
+DeviceManager::DeviceError DevicePluginButtons::executeAlternativePower(Device *device, const Action &action)
+{
+    // get the param value
+    bool power = AlternativePowerParams::fromAction(action).power;
 
-            // Set the "power" state
-            device->setStateValue(alternativePowerStateTypeId, power);
+    qCDebug(dcButtons) << "Alternative power button" << AlternativePowerButtonDeviceParams::fromDevice(device).name << "set power to" << power;
+    qCDebug(dcButtons) << "ActionTypeId :" << action.actionTypeId().toString();
+    qCDebug(dcButtons) << "StateTypeId  :" << alternativePowerStateTypeId.toString();
 
-            return DeviceManager::DeviceErrorNoError;
-        }
-        return DeviceManager::DeviceErrorActionTypeNotFound;
-    }
+    // Set the "power" state
+    device->setStateValue(alternativePowerStateTypeId, power);
 
-    return DeviceManager::DeviceErrorDeviceClassNotFound;
+    return DeviceManager::DeviceErrorNoError;
 }
-
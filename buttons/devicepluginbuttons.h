@@ -23,6 +23,7 @@
 
 #include "plugin/deviceplugin.h"
 #include "devicemanager.h"
+#include "plugintables.h"
 
 class DevicePluginButtons : public DevicePlugin
 {
@@ -38,6 +39,14 @@ public:
     DeviceManager::DeviceSetupStatus setupDevice(Device *device) override;
 
     DeviceManager::DeviceError executeAction(Device *device, const Action &action) override;
+
+private:
+    // The action handlers, called by executeAction through the generated ActionDispatch table
+    friend class ActionDispatch<DevicePluginButtons>;
+
+    DeviceManager::DeviceError executePressSimpleButton(Device *device, const Action &action);
+    DeviceManager::DeviceError executeSetPowerButton(Device *device, const Action &action);
+    DeviceManager::DeviceError executeAlternativePower(Device *device, const Action &action);
 };
 
 #endif // DEVICEPLUGINBUTTONS_H
@@ -18,5 +18,14 @@ infofile.input = JSONFILES
 
 QMAKE_EXTRA_COMPILERS += infofile
 
+# Lookup tables generated from the plugin JSON file (see tools/generateplugintables.py)
+plugintables.output = plugintables.h
+plugintables.commands = $$PWD/../tools/generateplugintables.py ${QMAKE_FILE_NAME} ${QMAKE_FILE_OUT}
+plugintables.depends = $$PWD/../tools/generateplugintables.py
+plugintables.CONFIG = no_link
+plugintables.input = JSONFILES
+
+QMAKE_EXTRA_COMPILERS += plugintables
+
 target.path = /usr/lib/guh/plugins/
 INSTALLS += target
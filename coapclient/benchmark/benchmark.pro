@@ -0,0 +1,25 @@
+# Benchmark of the CoAP client plugin against an in-process CoAP server, see main.cpp.
+# Build the plugin first, the benchmark loads it from the parent directory.
+JSONFILES = ../deviceplugincoapclient.json
+
+include(../../common/benchmark/benchmark.pri)
+
+TARGET = coapclient-benchmark
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    coapclientbenchmark.cpp \
+    coaploopbackserver.cpp \
+    coaptrafficreplay.cpp \
+    linkparserbenchmark.cpp \
+    ../linkformatparser.cpp \
+
+HEADERS += \
+    coapclientbenchmark.h \
+    coaploopbackserver.h \
+    coaptrafficreplay.h \
+    ../coaptrafficrecorder.h \
+    linkparserbenchmark.h \
+    ../linkformatparser.h \
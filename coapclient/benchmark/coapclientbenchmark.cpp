@@ -0,0 +1,105 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coapclientbenchmark.h"
+#include "extern-plugininfo.h"
+
+CoapClientBenchmark::CoapClientBenchmark(PluginBenchmarkHost *host, CoapLoopbackServer *server, const Options &options, QObject *parent) :
+    QObject(parent),
+    m_host(host),
+    m_server(server),
+    m_options(options)
+{
+}
+
+// Sets up the devices, each of them discovers the resources of the server
+QList<BenchmarkResult> CoapClientBenchmark::runSetup()
+{
+    // The discovery cache may not answer the discovery
+    m_host->setPluginConfig("discovery cache lifetime", 0);
+    m_host->setPluginConfig("max requests in flight", m_options.requestsInFlight);
+
+    QString url = m_server->url().toString();
+    BenchmarkResult setup = m_host->addDevices("setupDevice", m_options.devices, m_options.concurrency, infoDeviceClassId,
+                                               [url](int) { return ParamList() << Param("url", url); }, m_options.timeout);
+
+    return QList<BenchmarkResult>() << setup;
+}
+
+// Uploads messages round robin from all devices
+QList<BenchmarkResult> CoapClientBenchmark::runUpload()
+{
+    QList<Device *> devices = m_host->devices();
+    if (devices.isEmpty())
+        return QList<BenchmarkResult>();
+
+    QString message(m_options.uploadSize, QChar('x'));
+    BenchmarkResult upload = m_host->executeActions(QString("upload %1 bytes").arg(m_options.uploadSize), m_options.uploads, m_options.concurrency,
+                                                    [devices, message](int index) {
+        Action action(uploadActionTypeId, devices.at(index % devices.count())->id());
+        action.setParams(ParamList() << Param("message", message));
+        return action;
+    }, m_options.timeout);
+
+    return QList<BenchmarkResult>() << upload;
+}
+
+// Subscribes all devices to /obs and measures the time from sending a notification
+// until it changed the state of a device
+QList<BenchmarkResult> CoapClientBenchmark::runNotifications()
+{
+    QList<BenchmarkResult> results;
+    if (m_host->devices().isEmpty())
+        return results;
+
+    results << setNotifications("enable notifications", true);
+
+    BenchmarkResult delivery("notification delivery");
+    QMetaObject::Connection connection = connect(m_host->deviceManager(), &DeviceManager::deviceStateChanged,
+                                                 [&delivery](Device *device, const QUuid &stateTypeId, const QVariant &value) {
+        Q_UNUSED(device)
+        if (stateTypeId == temperatureStateTypeId)
+            delivery.addSample(BenchmarkResult::timestamp() - qint64(value.toDouble() * 1e6));
+    });
+
+    m_server->setNotificationInterval(m_options.notificationInterval);
+    delivery.start();
+    PluginBenchmarkHost::wait(m_options.duration);
+    delivery.finish();
+    m_server->setNotificationInterval(0);
+    disconnect(connection);
+
+    results << delivery;
+    results << setNotifications("disable notifications", false);
+    return results;
+}
+
+BenchmarkResult CoapClientBenchmark::setNotifications(const QString &name, bool enabled)
+{
+    QList<Device *> devices = m_host->devices();
+
+    // The notification state is writable, its action has the id of the state
+    ActionTypeId actionTypeId(notificationsStateTypeId.toString());
+    return m_host->executeActions(name, devices.count(), m_options.concurrency, [devices, actionTypeId, enabled](int index) {
+        Action action(actionTypeId, devices.at(index)->id());
+        action.setParams(ParamList() << Param("notification", enabled));
+        return action;
+    }, m_options.timeout);
+}
@@ -0,0 +1,62 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPCLIENTBENCHMARK_H
+#define COAPCLIENTBENCHMARK_H
+
+#include "pluginbenchmarkhost.h"
+#include "coaploopbackserver.h"
+
+#include <QObject>
+
+// Drives the CoAP client plugin against the loopback server: device setups with
+// resource discovery, uploads and the delivery of notifications.
+class CoapClientBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        Options() : devices(100), concurrency(16), uploads(1000), uploadSize(64), requestsInFlight(1),
+            notificationInterval(10), duration(5000), timeout(120000) { }
+        int devices;
+        int concurrency;
+        int uploads;
+        int uploadSize;
+        int requestsInFlight;
+        int notificationInterval;
+        int duration;
+        int timeout;
+    };
+
+    CoapClientBenchmark(PluginBenchmarkHost *host, CoapLoopbackServer *server, const Options &options, QObject *parent = 0);
+
+    QList<BenchmarkResult> runSetup();
+    QList<BenchmarkResult> runUpload();
+    QList<BenchmarkResult> runNotifications();
+
+private:
+    PluginBenchmarkHost *m_host;
+    CoapLoopbackServer *m_server;
+    Options m_options;
+
+    BenchmarkResult setNotifications(const QString &name, bool enabled);
+};
+
+#endif // COAPCLIENTBENCHMARK_H
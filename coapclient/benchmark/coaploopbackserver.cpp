@@ -0,0 +1,541 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coaploopbackserver.h"
+#include "benchmarkresult.h"
+
+// Response codes (class << 5 | detail)
+static const quint8 codeContent = 0x45;
+static const quint8 codeCreated = 0x41;
+static const quint8 codeContinue = 0x5f;
+static const quint8 codeNotFound = 0x84;
+static const quint8 codeMethodNotAllowed = 0x85;
+
+static const quint8 methodGet = 1;
+static const quint8 methodPost = 2;
+
+static const quint32 contentFormatLinkFormat = 40;
+static const quint32 contentFormatSenmlJson = 110;
+
+// Block size exponent of the link directory if the client asks for none (1024 bytes)
+static const quint32 defaultBlockSizeExponent = 6;
+
+CoapLoopbackServer::CoapLoopbackServer(QObject *parent) :
+    QObject(parent),
+    m_latency(0),
+    m_loss(0),
+    m_random(1),
+    m_linkCount(0),
+    m_messageId(0),
+    m_observeSequence(2),
+    m_requestCount(0),
+    m_notificationCount(0),
+    m_droppedCount(0)
+{
+    m_socket = new QUdpSocket(this);
+    connect(m_socket, &QUdpSocket::readyRead, this, &CoapLoopbackServer::onReadyRead);
+
+    m_notificationTimer = new QTimer(this);
+    m_notificationTimer->setInterval(1000);
+    connect(m_notificationTimer, &QTimer::timeout, this, &CoapLoopbackServer::onNotificationTimeout);
+}
+
+// Binds the server, port 0 picks a free port
+bool CoapLoopbackServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (!m_socket->bind(address, port)) {
+        qWarning() << "Could not bind the CoAP server to" << address.toString() << port << m_socket->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the URL of the server for the device params
+QUrl CoapLoopbackServer::url() const
+{
+    QUrl url;
+    url.setScheme("coap");
+    url.setHost(m_socket->localAddress().toString());
+    url.setPort(m_socket->localPort());
+    return url;
+}
+
+// Delays every datagram in both directions
+void CoapLoopbackServer::setLatency(int milliSeconds)
+{
+    m_latency = milliSeconds;
+}
+
+// Drops datagrams in both directions with the given probability
+void CoapLoopbackServer::setLoss(double probability)
+{
+    m_loss = qBound(0.0, probability, 1.0);
+}
+
+// The same seed drops the same datagrams
+void CoapLoopbackServer::setSeed(quint32 seed)
+{
+    m_random.seed(seed);
+}
+
+// Adds synthetic links to /.well-known/core, like a resource directory would have them
+void CoapLoopbackServer::setLinkCount(int count)
+{
+    m_linkCount = count;
+}
+
+// Interval of the /obs notifications, 0 disables them
+void CoapLoopbackServer::setNotificationInterval(int milliSeconds)
+{
+    if (milliSeconds <= 0) {
+        m_notificationTimer->stop();
+        return;
+    }
+
+    m_notificationTimer->start(milliSeconds);
+}
+
+// Returns the number of handled requests, retransmissions answered from the exchange cache don't count
+int CoapLoopbackServer::requestCount() const
+{
+    return m_requestCount;
+}
+
+int CoapLoopbackServer::notificationCount() const
+{
+    return m_notificationCount;
+}
+
+int CoapLoopbackServer::droppedCount() const
+{
+    return m_droppedCount;
+}
+
+// Returns the /.well-known/core payload with the given number of additional links
+QByteArray CoapLoopbackServer::linkDirectory(int linkCount)
+{
+    QByteArray links("</test>;rt=\"test\";ct=0,</obs>;obs;rt=\"observe\";title=\"Observable resource\";ct=110");
+    for (int i = 0; i < linkCount; i++) {
+        links.append(",</sensors/");
+        links.append(QByteArray::number(i));
+        links.append(">;rt=\"temperature-c\";if=\"sensor\";ct=110;sz=");
+        links.append(QByteArray::number(64 + i % 512));
+    }
+    return links;
+}
+
+bool CoapLoopbackServer::drop()
+{
+    if (m_loss <= 0)
+        return false;
+
+    if (std::uniform_real_distribution<double>(0, 1)(m_random) >= m_loss)
+        return false;
+
+    m_droppedCount++;
+    return true;
+}
+
+// Sends the message after the configured latency. Responses to confirmable requests are
+// kept with their exchange, so retransmissions of the request get the same response.
+void CoapLoopbackServer::send(const Message &message, const QHostAddress &address, quint16 port, const QByteArray &exchange)
+{
+    QByteArray data = message.pack();
+    if (!exchange.isEmpty()) {
+        if (m_responses.count() > 4096)
+            m_responses.clear();
+
+        m_responses.insert(exchange, data);
+    }
+
+    if (drop())
+        return;
+
+    if (m_latency <= 0) {
+        m_socket->writeDatagram(data, address, port);
+        return;
+    }
+
+    QTimer::singleShot(m_latency, this, [this, data, address, port]() {
+        m_socket->writeDatagram(data, address, port);
+    });
+}
+
+void CoapLoopbackServer::handleRequest(const Message &request, Message *response, const QHostAddress &address, quint16 port)
+{
+    QByteArray path = request.path();
+
+    if (path == ".well-known/core") {
+        if (request.code != methodGet) {
+            response->code = codeMethodNotAllowed;
+            return;
+        }
+
+        QByteArray links = linkDirectory(m_linkCount);
+        response->code = codeContent;
+        response->addUintOption(OptionContentFormat, contentFormatLinkFormat);
+
+        // Send the requested block, the first one if the directory doesn't fit into one
+        quint32 block = defaultBlockSizeExponent;
+        if (request.hasOption(OptionBlock2))
+            block = uintValue(request.option(OptionBlock2)) & ~0x08;
+
+        int size = 16 << qMin<quint32>(block & 0x07, 6);
+        int offset = (block >> 4) * size;
+        if (request.hasOption(OptionBlock2) || links.size() > size) {
+            bool more = offset + size < links.size();
+            response->addUintOption(OptionBlock2, block | (more ? 0x08 : 0));
+            response->payload = links.mid(offset, size);
+        } else {
+            response->payload = links;
+        }
+        return;
+    }
+
+    if (path == "test") {
+        if (request.code != methodPost) {
+            response->code = codeMethodNotAllowed;
+            return;
+        }
+
+        // Acknowledge each block of a block-wise upload, the last one creates the resource
+        if (request.hasOption(OptionBlock1)) {
+            quint32 block = uintValue(request.option(OptionBlock1));
+            response->code = (block & 0x08) ? codeContinue : codeCreated;
+            response->addUintOption(OptionBlock1, block);
+            return;
+        }
+
+        response->code = codeCreated;
+        return;
+    }
+
+    if (path == "obs") {
+        if (request.code != methodGet) {
+            response->code = codeMethodNotAllowed;
+            return;
+        }
+
+        // Register (0) or deregister (1) the observer (RFC 7641)
+        QByteArray key = address.toString().toLatin1() + ':' + QByteArray::number(port) + ':' + request.token.toHex();
+        if (request.hasOption(OptionObserve) && uintValue(request.option(OptionObserve)) == 0) {
+            Observer observer;
+            observer.address = address;
+            observer.port = port;
+            observer.token = request.token;
+            m_observers.insert(key, observer);
+            response->addUintOption(OptionObserve, m_observeSequence & 0xffffff);
+        } else {
+            m_observers.remove(key);
+        }
+
+        response->code = codeContent;
+        response->addUintOption(OptionContentFormat, contentFormatSenmlJson);
+        response->payload = senmlPayload();
+        return;
+    }
+
+    response->code = codeNotFound;
+}
+
+// The temperature carries the send time in milliseconds, so the benchmark gets the delivery
+// latency of a notification from the state change it causes
+QByteArray CoapLoopbackServer::senmlPayload()
+{
+    QByteArray payload("[{\"bn\":\"urn:dev:loopback:\",\"n\":\"temperature\",\"u\":\"Cel\",\"v\":");
+    payload.append(QByteArray::number(BenchmarkResult::timestamp() / 1e6, 'f', 3));
+    payload.append("},{\"n\":\"humidity\",\"u\":\"%RH\",\"v\":");
+    payload.append(QByteArray::number(m_observeSequence % 100));
+    payload.append("}]");
+    return payload;
+}
+
+quint32 CoapLoopbackServer::uintValue(const QByteArray &value)
+{
+    quint32 result = 0;
+    for (int i = 0; i < value.size() && i < 4; i++)
+        result = (result << 8) | quint8(value.at(i));
+
+    return result;
+}
+
+void CoapLoopbackServer::onReadyRead()
+{
+    while (m_socket->hasPendingDatagrams()) {
+        QByteArray data;
+        data.resize(m_socket->pendingDatagramSize());
+        QHostAddress address;
+        quint16 port;
+        m_socket->readDatagram(data.data(), data.size(), &address, &port);
+
+        if (drop())
+            continue;
+
+        Message request;
+        if (!request.parse(data))
+            continue;
+
+        // A reset ends the observation the rejected notification belongs to
+        if (request.type == TypeReset) {
+            QHash<QByteArray, Observer>::iterator it = m_observers.begin();
+            while (it != m_observers.end()) {
+                if (it.value().address == address && it.value().port == port && it.value().token == request.token) {
+                    it = m_observers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            continue;
+        }
+
+        // Acknowledgements of notifications and responses
+        if (request.type == TypeAcknowledgement || request.code >= 32)
+            continue;
+
+        // Ping
+        if (request.code == 0) {
+            Message reset;
+            reset.type = TypeReset;
+            reset.messageId = request.messageId;
+            send(reset, address, port);
+            continue;
+        }
+
+        // Answer retransmitted requests with the response of the first transmission
+        QByteArray exchange;
+        if (request.type == TypeConfirmable) {
+            exchange = address.toString().toLatin1() + ':' + QByteArray::number(port) + ':' + QByteArray::number(request.messageId);
+            QHash<QByteArray, QByteArray>::const_iterator it = m_responses.constFind(exchange);
+            if (it != m_responses.constEnd()) {
+                Message response;
+                response.parse(it.value());
+                send(response, address, port);
+                continue;
+            }
+        }
+
+        m_requestCount++;
+
+        // Confirmable requests get a piggybacked response
+        Message response;
+        response.token = request.token;
+        if (request.type == TypeConfirmable) {
+            response.type = TypeAcknowledgement;
+            response.messageId = request.messageId;
+        } else {
+            response.type = TypeNonConfirmable;
+            response.messageId = m_messageId++;
+        }
+
+        handleRequest(request, &response, address, port);
+        send(response, address, port, exchange);
+    }
+}
+
+// Sends the payload as the next notification of /obs to all observers
+void CoapLoopbackServer::notify(const QByteArray &payload)
+{
+    m_observeSequence++;
+
+    foreach (const Observer &observer, m_observers) {
+        Message notification;
+        notification.type = TypeNonConfirmable;
+        notification.code = codeContent;
+        notification.messageId = m_messageId++;
+        notification.token = observer.token;
+        notification.addUintOption(OptionObserve, m_observeSequence & 0xffffff);
+        notification.addUintOption(OptionContentFormat, contentFormatSenmlJson);
+        notification.payload = payload;
+
+        m_notificationCount++;
+        send(notification, observer.address, observer.port);
+    }
+}
+
+void CoapLoopbackServer::onNotificationTimeout()
+{
+    if (m_observers.isEmpty())
+        return;
+
+    notify(senmlPayload());
+}
+
+// Parses a CoAP message (RFC 7252, section 3)
+bool CoapLoopbackServer::Message::parse(const QByteArray &data)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    int size = data.size();
+    if (size < 4 || (bytes[0] >> 6) != 1)
+        return false;
+
+    type = Type((bytes[0] >> 4) & 0x03);
+    int tokenLength = bytes[0] & 0x0f;
+    code = bytes[1];
+    messageId = quint16((bytes[2] << 8) | bytes[3]);
+    if (tokenLength > 8 || 4 + tokenLength > size)
+        return false;
+
+    token = data.mid(4, tokenLength);
+    options.clear();
+    payload.clear();
+
+    int position = 4 + tokenLength;
+    quint16 number = 0;
+    while (position < size) {
+        if (bytes[position] == 0xff) {
+            if (position + 1 == size)
+                return false;
+
+            payload = data.mid(position + 1);
+            return true;
+        }
+
+        int delta = bytes[position] >> 4;
+        int length = bytes[position] & 0x0f;
+        position++;
+
+        // Extended delta and length
+        int *fields[] = { &delta, &length };
+        for (int i = 0; i < 2; i++) {
+            int &field = *fields[i];
+            if (field == 13) {
+                if (position + 1 > size)
+                    return false;
+                field = 13 + bytes[position];
+                position += 1;
+            } else if (field == 14) {
+                if (position + 2 > size)
+                    return false;
+                field = 269 + ((bytes[position] << 8) | bytes[position + 1]);
+                position += 2;
+            } else if (field == 15) {
+                return false;
+            }
+        }
+
+        if (position + length > size)
+            return false;
+
+        number += delta;
+        options.append(qMakePair(number, data.mid(position, length)));
+        position += length;
+    }
+
+    return true;
+}
+
+QByteArray CoapLoopbackServer::Message::pack() const
+{
+    QByteArray data;
+    data.append(char(0x40 | (type << 4) | token.size()));
+    data.append(char(code));
+    data.append(char(messageId >> 8));
+    data.append(char(messageId & 0xff));
+    data.append(token);
+
+    // The options are kept in the order of their numbers
+    quint16 number = 0;
+    for (int i = 0; i < options.count(); i++) {
+        int delta = options.at(i).first - number;
+        int length = options.at(i).second.size();
+        number = options.at(i).first;
+
+        QByteArray extended;
+        int nibbles[] = { delta, length };
+        for (int j = 0; j < 2; j++) {
+            if (nibbles[j] >= 269) {
+                extended.append(char((nibbles[j] - 269) >> 8));
+                extended.append(char((nibbles[j] - 269) & 0xff));
+                nibbles[j] = 14;
+            } else if (nibbles[j] >= 13) {
+                extended.append(char(nibbles[j] - 13));
+                nibbles[j] = 13;
+            }
+        }
+
+        data.append(char((nibbles[0] << 4) | nibbles[1]));
+        data.append(extended);
+        data.append(options.at(i).second);
+    }
+
+    if (!payload.isEmpty()) {
+        data.append(char(0xff));
+        data.append(payload);
+    }
+
+    return data;
+}
+
+bool CoapLoopbackServer::Message::hasOption(quint16 number) const
+{
+    for (int i = 0; i < options.count(); i++) {
+        if (options.at(i).first == number)
+            return true;
+    }
+    return false;
+}
+
+QByteArray CoapLoopbackServer::Message::option(quint16 number) const
+{
+    for (int i = 0; i < options.count(); i++) {
+        if (options.at(i).first == number)
+            return options.at(i).second;
+    }
+    return QByteArray();
+}
+
+// Returns the Uri-Path options joined with slashes
+QByteArray CoapLoopbackServer::Message::path() const
+{
+    QByteArray path;
+    for (int i = 0; i < options.count(); i++) {
+        if (options.at(i).first != OptionUriPath)
+            continue;
+
+        if (!path.isEmpty())
+            path.append('/');
+
+        path.append(options.at(i).second);
+    }
+    return path;
+}
+
+// Inserts the option behind the options with the same or a lower number
+void CoapLoopbackServer::Message::addOption(quint16 number, const QByteArray &value)
+{
+    int i = 0;
+    while (i < options.count() && options.at(i).first <= number)
+        i++;
+
+    options.insert(i, qMakePair(number, value));
+}
+
+// Adds an option with an unsigned integer value in as few bytes as possible
+void CoapLoopbackServer::Message::addUintOption(quint16 number, quint32 value)
+{
+    QByteArray data;
+    while (value != 0) {
+        data.prepend(char(value & 0xff));
+        value >>= 8;
+    }
+
+    addOption(number, data);
+}
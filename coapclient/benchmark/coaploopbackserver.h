@@ -0,0 +1,138 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPLOOPBACKSERVER_H
+#define COAPLOOPBACKSERVER_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QHash>
+#include <QUrl>
+
+#include <random>
+
+// CoAP server on localhost standing in for real devices in the benchmarks. It serves
+// the resources the plugin uses:
+//
+//   /.well-known/core   the link directory, block-wise if it is large (Block2)
+//   /test               POST, block-wise uploads are acknowledged (Block1)
+//   /obs                observable SenML resource, notifies all observers periodically
+//
+// Datagrams can be delayed and dropped in both directions to simulate a real network.
+// The server has its own small message codec, it doesn't share code with the client.
+class CoapLoopbackServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoapLoopbackServer(QObject *parent = 0);
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 0);
+    QUrl url() const;
+
+    void setLatency(int milliSeconds);
+    void setLoss(double probability);
+    void setSeed(quint32 seed);
+    void setLinkCount(int count);
+    void setNotificationInterval(int milliSeconds);
+
+    void notify(const QByteArray &payload);
+
+    int requestCount() const;
+    int notificationCount() const;
+    int droppedCount() const;
+
+    static QByteArray linkDirectory(int linkCount);
+
+private:
+    enum Type {
+        TypeConfirmable = 0,
+        TypeNonConfirmable = 1,
+        TypeAcknowledgement = 2,
+        TypeReset = 3
+    };
+
+    enum Option {
+        OptionObserve = 6,
+        OptionUriPath = 11,
+        OptionContentFormat = 12,
+        OptionMaxAge = 14,
+        OptionBlock2 = 23,
+        OptionBlock1 = 27
+    };
+
+    struct Message {
+        Message() : type(TypeConfirmable), code(0), messageId(0) { }
+        Type type;
+        quint8 code;
+        quint16 messageId;
+        QByteArray token;
+        QList<QPair<quint16, QByteArray> > options;
+        QByteArray payload;
+
+        bool parse(const QByteArray &data);
+        QByteArray pack() const;
+
+        bool hasOption(quint16 number) const;
+        QByteArray option(quint16 number) const;
+        QByteArray path() const;
+        void addOption(quint16 number, const QByteArray &value);
+        void addUintOption(quint16 number, quint32 value);
+    };
+
+    struct Observer {
+        QHostAddress address;
+        quint16 port;
+        QByteArray token;
+    };
+
+    QUdpSocket *m_socket;
+    QTimer *m_notificationTimer;
+
+    int m_latency;
+    double m_loss;
+    std::minstd_rand m_random;
+    int m_linkCount;
+
+    quint16 m_messageId;
+    quint32 m_observeSequence;
+
+    // Responses of the recent confirmable requests, retransmissions get the same answer
+    QHash<QByteArray, QByteArray> m_responses;
+    QHash<QByteArray, Observer> m_observers;
+
+    int m_requestCount;
+    int m_notificationCount;
+    int m_droppedCount;
+
+    bool drop();
+    void send(const Message &message, const QHostAddress &address, quint16 port, const QByteArray &exchange = QByteArray());
+    void handleRequest(const Message &request, Message *response, const QHostAddress &address, quint16 port);
+    QByteArray senmlPayload();
+
+    static quint32 uintValue(const QByteArray &value);
+
+private slots:
+    void onReadyRead();
+    void onNotificationTimeout();
+};
+
+#endif // COAPLOOPBACKSERVER_H
@@ -0,0 +1,281 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coaptrafficreplay.h"
+#include "extern-plugininfo.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFile>
+
+CoapTrafficReplay::CoapTrafficReplay(PluginBenchmarkHost *host, QObject *parent) :
+    QObject(parent),
+    m_host(host),
+    m_serverLatency(0),
+    m_serverLoss(0)
+{
+}
+
+// Reads the events of the capture, captures of version 1 have no time records
+bool CoapTrafficReplay::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open capture file" << fileName << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != CoapTrafficRecorder::magic || version < 1 || version > CoapTrafficRecorder::version) {
+        qWarning() << "Unsupported capture file" << fileName;
+        return false;
+    }
+
+    m_events.clear();
+    m_endpoints.clear();
+    m_recordCounts.clear();
+
+    QHash<quint16, QUrl> urls;
+    qint64 time = 0;
+    while (!stream.atEnd()) {
+        quint8 type;
+        quint32 delta;
+        stream >> type >> delta;
+        time += delta;
+
+        Event event;
+        event.type = CoapTrafficRecorder::RecordType(type);
+        event.requestType = 0;
+
+        quint32 request;
+        quint16 index;
+        quint8 statusCode;
+        quint8 error;
+        quint32 notificationNumber;
+        QByteArray data;
+
+        switch (event.type) {
+        case CoapTrafficRecorder::RecordTypeUrl:
+            stream >> index >> data;
+            urls.insert(index, QUrl::fromEncoded(data));
+            break;
+        case CoapTrafficRecorder::RecordTypeRequest:
+            stream >> request >> event.requestType >> index >> event.payload;
+            event.url = urls.value(index);
+            break;
+        case CoapTrafficRecorder::RecordTypeResponse:
+            stream >> request >> statusCode >> error >> data;
+            break;
+        case CoapTrafficRecorder::RecordTypeTimeout:
+            stream >> request;
+            break;
+        case CoapTrafficRecorder::RecordTypeNotification:
+            stream >> index >> notificationNumber >> event.payload;
+            event.url = urls.value(index);
+            break;
+        case CoapTrafficRecorder::RecordTypeTime:
+            stream >> time;
+            break;
+        default:
+            qWarning() << "Unknown record type" << type << "in" << fileName;
+            return false;
+        }
+
+        if (stream.status() != QDataStream::Ok) {
+            qWarning() << "Truncated capture file" << fileName;
+            break;
+        }
+
+        m_recordCounts[event.type]++;
+        if (event.type != CoapTrafficRecorder::RecordTypeRequest && event.type != CoapTrafficRecorder::RecordTypeNotification)
+            continue;
+
+        // Every server of the capture gets its own device
+        if (!m_endpoints.contains(endpointName(event.url)))
+            m_endpoints.append(endpointName(event.url));
+
+        // The devices are set up before the replay starts
+        if (event.requestType == RequestTypeDiscover || event.requestType == RequestTypeRevalidate)
+            continue;
+
+        event.time = time;
+        m_events.append(event);
+    }
+
+    return true;
+}
+
+void CoapTrafficReplay::setServerLatency(int milliSeconds)
+{
+    m_serverLatency = milliSeconds;
+}
+
+void CoapTrafficReplay::setServerLoss(double probability)
+{
+    m_serverLoss = probability;
+}
+
+// Replays the events with the given speed factor, 0 replays them as fast as possible
+// with at most concurrency actions running at the same time
+QList<BenchmarkResult> CoapTrafficReplay::run(double speed, int concurrency, int timeout)
+{
+    QList<BenchmarkResult> results;
+
+    // One loopback server for each recorded server
+    QHash<QString, CoapLoopbackServer *> servers;
+    QStringList serverUrls;
+    foreach (const QString &endpoint, m_endpoints) {
+        CoapLoopbackServer *server = new CoapLoopbackServer(this);
+        server->setLatency(m_serverLatency);
+        server->setLoss(m_serverLoss);
+        if (!server->listen())
+            return results;
+
+        servers.insert(endpoint, server);
+        serverUrls.append(server->url().toString());
+    }
+
+    results << m_host->addDevices("replay setupDevice", serverUrls.count(), concurrency, infoDeviceClassId, [serverUrls](int index) {
+        return ParamList() << Param("url", serverUrls.at(index));
+    }, timeout);
+
+    QHash<QString, Device *> devices;
+    foreach (Device *device, m_host->devices()) {
+        int index = serverUrls.indexOf(device->paramValue("url").toString());
+        if (index >= 0)
+            devices.insert(m_endpoints.at(index), device);
+    }
+
+    BenchmarkResult uploads("replay upload");
+    BenchmarkResult subscriptions("replay notification actions");
+    BenchmarkResult notifications("replay notification delivery");
+
+    // Actions in flight -> start time and result
+    QHash<ActionId, QPair<qint64, BenchmarkResult *> > running;
+    connect(m_host->deviceManager(), &DeviceManager::actionExecutionFinished, this, [&running](const ActionId &actionId, DeviceManager::DeviceError error) {
+        if (!running.contains(actionId))
+            return;
+
+        QPair<qint64, BenchmarkResult *> action = running.take(actionId);
+        if (error == DeviceManager::DeviceErrorNoError) {
+            action.second->addSample(BenchmarkResult::timestamp() - action.first);
+        } else {
+            action.second->addFailure();
+        }
+    });
+
+    // Time from the last notification sent to a device until it changed a state
+    QHash<Device *, qint64> notified;
+    connect(m_host->deviceManager(), &DeviceManager::deviceStateChanged, this, [&notified, &notifications](Device *device) {
+        if (notified.contains(device))
+            notifications.addSample(BenchmarkResult::timestamp() - notified.take(device));
+    });
+
+    uploads.start();
+    subscriptions.start();
+    notifications.start();
+
+    qint64 start = BenchmarkResult::timestamp();
+    qint64 deadline = start + qint64(timeout) * 1000000;
+    foreach (const Event &event, m_events) {
+        // Keep the recorded pace or the limit of concurrent actions
+        if (speed > 0) {
+            qint64 due = start + qint64(event.time * 1000 / speed);
+            while (BenchmarkResult::timestamp() < due)
+                PluginBenchmarkHost::wait(qMax<qint64>(1, (due - BenchmarkResult::timestamp()) / 1000000));
+        } else {
+            while (running.count() >= concurrency && BenchmarkResult::timestamp() < deadline)
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        }
+
+        QString endpoint = endpointName(event.url);
+        Device *device = devices.value(endpoint);
+        if (!device)
+            continue;
+
+        if (event.type == CoapTrafficRecorder::RecordTypeNotification) {
+            notified.insert(device, BenchmarkResult::timestamp());
+            servers.value(endpoint)->notify(event.payload);
+            continue;
+        }
+
+        Action action(uploadActionTypeId, device->id());
+        BenchmarkResult *result = &uploads;
+        if (event.requestType == RequestTypeUpload) {
+            action.setParams(ParamList() << Param("message", QString::fromUtf8(event.payload)));
+        } else {
+            // The notification state is writable, its action has the id of the state
+            action = Action(ActionTypeId(notificationsStateTypeId.toString()), device->id());
+            action.setParams(ParamList() << Param("notification", event.requestType == RequestTypeEnableNotifications));
+            result = &subscriptions;
+        }
+
+        qint64 begin = BenchmarkResult::timestamp();
+        running.insert(action.id(), qMakePair(begin, result));
+        DeviceManager::DeviceError error = m_host->deviceManager()->executeAction(action);
+        if (error == DeviceManager::DeviceErrorAsync)
+            continue;
+
+        running.remove(action.id());
+        if (error == DeviceManager::DeviceErrorNoError) {
+            result->addSample(BenchmarkResult::timestamp() - begin);
+        } else {
+            result->addFailure();
+        }
+    }
+
+    // Wait for the last actions and notifications
+    while (!running.isEmpty() && BenchmarkResult::timestamp() < deadline)
+        PluginBenchmarkHost::wait(10);
+
+    PluginBenchmarkHost::wait(100);
+    disconnect(m_host->deviceManager(), 0, this, 0);
+
+    QHash<ActionId, QPair<qint64, BenchmarkResult *> >::const_iterator it;
+    for (it = running.constBegin(); it != running.constEnd(); ++it)
+        it.value().second->addFailure();
+
+    uploads.finish();
+    subscriptions.finish();
+    notifications.finish();
+    results << uploads << subscriptions << notifications;
+
+    qDeleteAll(servers);
+    return results;
+}
+
+// Returns the record counts of the loaded capture
+QString CoapTrafficReplay::summary() const
+{
+    return QString("capture: %1 requests, %2 responses, %3 timeouts, %4 notifications, %5 servers")
+            .arg(m_recordCounts.value(CoapTrafficRecorder::RecordTypeRequest))
+            .arg(m_recordCounts.value(CoapTrafficRecorder::RecordTypeResponse))
+            .arg(m_recordCounts.value(CoapTrafficRecorder::RecordTypeTimeout))
+            .arg(m_recordCounts.value(CoapTrafficRecorder::RecordTypeNotification))
+            .arg(m_endpoints.count());
+}
+
+QString CoapTrafficReplay::endpointName(const QUrl &url)
+{
+    return url.host() + ":" + QString::number(url.port(5683));
+}
@@ -0,0 +1,80 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPTRAFFICREPLAY_H
+#define COAPTRAFFICREPLAY_H
+
+#include "pluginbenchmarkhost.h"
+#include "coaploopbackserver.h"
+#include "coaptrafficrecorder.h"
+
+#include <QObject>
+#include <QHash>
+#include <QUrl>
+
+// Replays a capture of CoapTrafficRecorder against the plugin. Every recorded server
+// gets a loopback server and a device. The uploads and notification subscriptions of
+// the capture are executed as actions and the recorded notifications are sent by the
+// loopback servers, at the original speed or as fast as possible. The responses
+// come from the loopback servers, the recorded ones are only counted.
+class CoapTrafficReplay : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoapTrafficReplay(PluginBenchmarkHost *host, QObject *parent = 0);
+
+    bool load(const QString &fileName);
+
+    void setServerLatency(int milliSeconds);
+    void setServerLoss(double probability);
+
+    QList<BenchmarkResult> run(double speed, int concurrency, int timeout);
+    QString summary() const;
+
+private:
+    // The values of DevicePluginCoapClient::RequestType in the capture
+    enum RequestType {
+        RequestTypeDiscover,
+        RequestTypeRevalidate,
+        RequestTypeEnableNotifications,
+        RequestTypeDisableNotifications,
+        RequestTypeUpload
+    };
+
+    struct Event {
+        qint64 time;
+        CoapTrafficRecorder::RecordType type;
+        quint8 requestType;
+        QUrl url;
+        QByteArray payload;
+    };
+
+    PluginBenchmarkHost *m_host;
+    QList<Event> m_events;
+    QStringList m_endpoints;
+    QHash<CoapTrafficRecorder::RecordType, int> m_recordCounts;
+
+    int m_serverLatency;
+    double m_serverLoss;
+
+    static QString endpointName(const QUrl &url);
+};
+
+#endif // COAPTRAFFICREPLAY_H
@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "linkparserbenchmark.h"
+#include "linkformatparser.h"
+#include "coaploopbackserver.h"
+
+#include "coap/corelinkparser.h"
+
+// Both parsers read the path and the observable flag of every link, like the setup does
+QList<BenchmarkResult> LinkParserBenchmark::run(const QList<int> &linkCounts, int iterations)
+{
+    QList<BenchmarkResult> results;
+
+    foreach (int linkCount, linkCounts) {
+        QByteArray payload = CoapLoopbackServer::linkDirectory(linkCount);
+        int expected = linkCount + 2;
+
+        results << BenchmarkResult::measure(QString("CoreLinkParser %1 links").arg(linkCount), iterations, [&payload, expected](int) {
+            CoreLinkParser parser(payload);
+            int links = 0;
+            int observable = 0;
+            foreach (const CoreLink &link, parser.links()) {
+                links += link.path().isEmpty() ? 0 : 1;
+                observable += link.observable() ? 1 : 0;
+            }
+            return links == expected && observable == 1;
+        });
+
+        results << BenchmarkResult::measure(QString("LinkFormatParser %1 links").arg(linkCount), iterations, [&payload, expected](int) {
+            LinkFormatParser parser(payload);
+            LinkFormatParser::Link link;
+            int links = 0;
+            int observable = 0;
+            while (parser.next(&link)) {
+                links += link.path().isEmpty() ? 0 : 1;
+                observable += link.hasAttribute("obs") ? 1 : 0;
+            }
+            return !parser.hasError() && links == expected && observable == 1;
+        });
+    }
+
+    return results;
+}
@@ -0,0 +1,147 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "plugininfo.h"
+#include "coapclientbenchmark.h"
+#include "coaploopbackserver.h"
+#include "coaptrafficreplay.h"
+#include "linkparserbenchmark.h"
+#include "pluginbenchmarkhost.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+// Benchmark of the CoAP client plugin against an in-process CoAP server
+//
+//   coapclient-benchmark [options] [setup] [upload] [notifications] [linkparser]
+//   coapclient-benchmark --replay-file capture.ctrc [--speed 0] replay
+//
+// Prints p50/p99 latency, operations per second and allocations per operation.
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    application.setApplicationName("coapclient-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark of the CoAP client plugin against a loopback CoAP server.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("benchmarks", "The benchmarks to run: setup, upload, notifications, linkparser, replay (default: all but replay).");
+
+    QCommandLineOption pluginPathOption("plugin-path", "Directory of the built plugin.", "path", QCoreApplication::applicationDirPath() + "/..");
+    QCommandLineOption devicesOption("devices", "Number of devices.", "count", "100");
+    QCommandLineOption concurrencyOption("concurrency", "Setups and actions running at the same time.", "count", "16");
+    QCommandLineOption uploadsOption("uploads", "Number of upload actions.", "count", "1000");
+    QCommandLineOption uploadSizeOption("upload-size", "Size of an upload in bytes.", "bytes", "64");
+    QCommandLineOption inFlightOption("in-flight", "The \"max requests in flight\" of the plugin.", "count", "1");
+    QCommandLineOption latencyOption("latency", "Delay of each datagram in milliseconds.", "ms", "0");
+    QCommandLineOption lossOption("loss", "Probability of a datagram to be dropped, in percent.", "percent", "0");
+    QCommandLineOption seedOption("seed", "Seed of the datagram loss.", "seed", "1");
+    QCommandLineOption linksOption("links", "Additional links in /.well-known/core.", "count", "0");
+    QCommandLineOption intervalOption("notification-interval", "Interval of the /obs notifications in milliseconds.", "ms", "10");
+    QCommandLineOption durationOption("duration", "Duration of the notification benchmark in milliseconds.", "ms", "5000");
+    QCommandLineOption timeoutOption("timeout", "Time limit of each benchmark in milliseconds.", "ms", "120000");
+    QCommandLineOption iterationsOption("iterations", "Iterations of the parser benchmarks.", "count", "100");
+    QCommandLineOption replayFileOption("replay-file", "Capture of the \"capture file\" setting to replay.", "file");
+    QCommandLineOption speedOption("speed", "Speed of the replay, 1 is the recorded speed, 0 as fast as possible.", "factor", "1");
+    parser.addOptions(QList<QCommandLineOption>() << pluginPathOption << devicesOption << concurrencyOption << uploadsOption
+                      << uploadSizeOption << inFlightOption << latencyOption << lossOption << seedOption << linksOption
+                      << intervalOption << durationOption << timeoutOption << iterationsOption
+                      << replayFileOption << speedOption);
+    parser.process(application);
+
+    QStringList benchmarks = parser.positionalArguments();
+    if (benchmarks.isEmpty())
+        benchmarks << "setup" << "upload" << "notifications" << "linkparser";
+
+    QList<BenchmarkResult> results;
+    if (benchmarks.contains("linkparser"))
+        results << LinkParserBenchmark::run(QList<int>() << 1000 << 10000 << 50000, parser.value(iterationsOption).toInt());
+
+    // The remaining benchmarks run the plugin
+    QStringList pluginBenchmarks = QStringList() << "setup" << "upload" << "notifications" << "replay";
+    bool runPlugin = false;
+    foreach (const QString &benchmark, benchmarks) {
+        runPlugin |= pluginBenchmarks.contains(benchmark);
+    }
+
+    CoapLoopbackServer server;
+    server.setLatency(parser.value(latencyOption).toInt());
+    server.setLoss(parser.value(lossOption).toDouble() / 100);
+    server.setSeed(parser.value(seedOption).toUInt());
+    server.setLinkCount(parser.value(linksOption).toInt());
+
+    PluginBenchmarkHost host(infoDeviceClassId);
+    if (runPlugin) {
+        if (!server.listen() || !host.load(parser.value(pluginPathOption)))
+            return 1;
+
+        // The metrics would change states in the middle of the measurements
+        host.setPluginConfig("metrics interval", 0);
+    }
+
+    CoapClientBenchmark::Options options;
+    options.devices = parser.value(devicesOption).toInt();
+    options.concurrency = qMax(1, parser.value(concurrencyOption).toInt());
+    options.uploads = parser.value(uploadsOption).toInt();
+    options.uploadSize = parser.value(uploadSizeOption).toInt();
+    options.requestsInFlight = qMax(1, parser.value(inFlightOption).toInt());
+    options.notificationInterval = parser.value(intervalOption).toInt();
+    options.duration = parser.value(durationOption).toInt();
+    options.timeout = parser.value(timeoutOption).toInt();
+    CoapClientBenchmark benchmark(&host, &server, options);
+
+    // The other plugin benchmarks need the devices
+    bool runLoopback = benchmarks.contains("setup") || benchmarks.contains("upload") || benchmarks.contains("notifications");
+    if (runLoopback)
+        results << benchmark.runSetup();
+
+    if (benchmarks.contains("upload"))
+        results << benchmark.runUpload();
+
+    if (benchmarks.contains("notifications"))
+        results << benchmark.runNotifications();
+
+    QString captureSummary;
+    if (benchmarks.contains("replay")) {
+        CoapTrafficReplay replay(&host);
+        replay.setServerLatency(parser.value(latencyOption).toInt());
+        replay.setServerLoss(parser.value(lossOption).toDouble() / 100);
+        if (!replay.load(parser.value(replayFileOption)))
+            return 1;
+
+        results << replay.run(qMax(0.0, parser.value(speedOption).toDouble()), options.concurrency, options.timeout);
+        captureSummary = replay.summary();
+    }
+
+    QTextStream out(stdout);
+    out << BenchmarkResult::header() << endl;
+    foreach (const BenchmarkResult &result, results) {
+        out << result.toString() << endl;
+    }
+
+    out << endl;
+    out << "server: " << server.requestCount() << " requests, " << server.notificationCount() << " notifications, "
+        << server.droppedCount() << " datagrams dropped" << endl;
+    if (!captureSummary.isEmpty())
+        out << captureSummary << endl;
+    out << "peak memory: " << AllocationCounter::peakMemory() / 1024 << " KiB" << endl;
+    return 0;
+}
@@ -6,8 +6,28 @@ message(============================================)
 message("Qt version: $$[QT_VERSION]")
 message("Building $$deviceplugin$${TARGET}.so")
 
+INCLUDEPATH += ../common
+
 SOURCES += \
     deviceplugincoapclient.cpp \
+    coapdiscoverycache.cpp \
+    coapmetrics.cpp \
+    coapmulticastdiscovery.cpp \
+    coapnotificationqueue.cpp \
+    coaprttestimator.cpp \
+    coaptrafficrecorder.cpp \
+    senmldecoder.cpp \
+    linkformatparser.cpp \
+    ../common/statesnapshot.cpp \
 
 HEADERS += \
     deviceplugincoapclient.h \
+    coapdiscoverycache.h \
+    coapmetrics.h \
+    coapmulticastdiscovery.h \
+    coapnotificationqueue.h \
+    coaprttestimator.h \
+    coaptrafficrecorder.h \
+    senmldecoder.h \
+    linkformatparser.h \
+    ../common/statesnapshot.h \
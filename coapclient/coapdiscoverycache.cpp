@@ -0,0 +1,149 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coapdiscoverycache.h"
+#include "extern-plugininfo.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+
+// Bump this whenever the layout of the cache file changes
+static const quint32 cacheFileVersion = 1;
+
+CoapDiscoveryCache::CoapDiscoveryCache(const QString &fileName, QObject *parent) :
+    QObject(parent),
+    m_fileName(fileName),
+    m_lifetime(86400)
+{
+    // Collect changes for a few seconds, many devices get discovered at once during startup
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(5000);
+    connect(m_saveTimer, &QTimer::timeout, this, &CoapDiscoveryCache::save);
+
+    load();
+}
+
+// Writes the changes still waiting for the save timer
+CoapDiscoveryCache::~CoapDiscoveryCache()
+{
+    if (m_saveTimer->isActive())
+        save();
+}
+
+// Sets how long a discovery result will be considered fresh
+void CoapDiscoveryCache::setLifetime(int seconds)
+{
+    m_lifetime = seconds;
+}
+
+bool CoapDiscoveryCache::isFresh(const QUrl &url) const
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(url.toString());
+    if (it == m_entries.constEnd())
+        return false;
+
+    return it.value().timestamp.secsTo(QDateTime::currentDateTimeUtc()) < m_lifetime;
+}
+
+// Returns the cached CoRE link format payload of the given discovery URL
+QByteArray CoapDiscoveryCache::links(const QUrl &url) const
+{
+    return m_entries.value(url.toString()).links;
+}
+
+void CoapDiscoveryCache::insert(const QUrl &url, const QByteArray &links)
+{
+    Entry entry;
+    entry.links = links;
+    entry.timestamp = QDateTime::currentDateTimeUtc();
+    m_entries.insert(url.toString(), entry);
+
+    // Don't postpone a pending save, otherwise a steady stream of discoveries is never written
+    if (!m_saveTimer->isActive())
+        m_saveTimer->start();
+}
+
+void CoapDiscoveryCache::remove(const QUrl &url)
+{
+    if (m_entries.remove(url.toString()) > 0 && !m_saveTimer->isActive())
+        m_saveTimer->start();
+}
+
+void CoapDiscoveryCache::load()
+{
+    QFile file(m_fileName);
+    if (!file.exists())
+        return;
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(dcCoapClient) << "Could not open discovery cache" << m_fileName << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint32 version = 0;
+    stream >> version;
+    if (version != cacheFileVersion) {
+        qCWarning(dcCoapClient) << "Ignoring discovery cache with unknown version" << version;
+        return;
+    }
+
+    quint32 count = 0;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QString url;
+        Entry entry;
+        stream >> url >> entry.timestamp >> entry.links;
+        m_entries.insert(url, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(dcCoapClient) << "Discovery cache" << m_fileName << "is corrupt";
+        m_entries.clear();
+        return;
+    }
+
+    qCDebug(dcCoapClient) << "Loaded" << m_entries.count() << "cached resource discoveries";
+}
+
+void CoapDiscoveryCache::save()
+{
+    m_saveTimer->stop();
+
+    // Write to a temporary file first so a crash can't leave a half written cache behind
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(dcCoapClient) << "Could not write discovery cache" << m_fileName << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << cacheFileVersion << quint32(m_entries.count());
+    QHash<QString, Entry>::const_iterator it;
+    for (it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        stream << it.key() << it.value().timestamp << it.value().links;
+    }
+
+    if (!file.commit()) {
+        qCWarning(dcCoapClient) << "Could not write discovery cache" << m_fileName << file.errorString();
+    }
+}
@@ -0,0 +1,63 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPDISCOVERYCACHE_H
+#define COAPDISCOVERYCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QUrl>
+#include <QTimer>
+#include <QDateTime>
+
+// Persistent cache of the /.well-known/core resource discovery results of the CoAP servers
+class CoapDiscoveryCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoapDiscoveryCache(const QString &fileName, QObject *parent = 0);
+    ~CoapDiscoveryCache();
+
+    void setLifetime(int seconds);
+
+    bool isFresh(const QUrl &url) const;
+    QByteArray links(const QUrl &url) const;
+
+    void insert(const QUrl &url, const QByteArray &links);
+    void remove(const QUrl &url);
+
+private:
+    struct Entry {
+        QByteArray links;
+        QDateTime timestamp;
+    };
+
+    QString m_fileName;
+    int m_lifetime;
+    QHash<QString, Entry> m_entries;
+    QTimer *m_saveTimer;
+
+    void load();
+
+private slots:
+    void save();
+};
+
+#endif // COAPDISCOVERYCACHE_H
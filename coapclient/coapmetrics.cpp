@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coapmetrics.h"
+
+#include <cstring>
+
+// Upper bounds of the round trip time buckets in milliseconds, the last bucket takes the rest
+static const qint64 bucketLimits[] = { 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000 };
+
+CoapMetrics::CoapMetrics() :
+    m_requestsSent(0),
+    m_slowExchanges(0),
+    m_timeouts(0),
+    m_notificationsReceived(0),
+    m_notificationsDropped(0),
+    m_samples(0),
+    m_maximumRoundTripTime(0)
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+void CoapMetrics::addNotification(bool dropped)
+{
+    m_notificationsReceived++;
+    if (dropped)
+        m_notificationsDropped++;
+}
+
+void CoapMetrics::addRoundTripTime(qint64 milliSeconds)
+{
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && milliSeconds > bucketLimits[bucket]) {
+        bucket++;
+    }
+
+    m_buckets[bucket]++;
+    m_samples++;
+    m_maximumRoundTripTime = qMax(m_maximumRoundTripTime, milliSeconds);
+}
+
+// Returns the upper bound of the bucket containing the given percentile of all round trip times
+qint64 CoapMetrics::roundTripTimePercentile(int percentile) const
+{
+    if (m_samples == 0)
+        return 0;
+
+    quint64 rank = (quint64(m_samples) * percentile + 99) / 100;
+    quint64 count = 0;
+    for (int bucket = 0; bucket < BucketCount - 1; bucket++) {
+        count += m_buckets[bucket];
+        if (count >= rank)
+            return qMin(bucketLimits[bucket], m_maximumRoundTripTime);
+    }
+
+    return m_maximumRoundTripTime;
+}
@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPMETRICS_H
+#define COAPMETRICS_H
+
+#include <QtGlobal>
+
+// Transport counters and round trip time histogram of one CoAP server. Recording
+// only touches fixed size members, so it can be done on every reply.
+class CoapMetrics
+{
+public:
+    CoapMetrics();
+
+    void addRequestSent() { m_requestsSent++; }
+    void addSlowExchange() { m_slowExchanges++; }
+    void addTimeout() { m_timeouts++; }
+    void addNotification(bool dropped);
+    void addRoundTripTime(qint64 milliSeconds);
+
+    quint32 requestsSent() const { return m_requestsSent; }
+    quint32 slowExchanges() const { return m_slowExchanges; }
+    quint32 timeouts() const { return m_timeouts; }
+    quint32 notificationsReceived() const { return m_notificationsReceived; }
+    quint32 notificationsDropped() const { return m_notificationsDropped; }
+
+    qint64 roundTripTimePercentile(int percentile) const;
+
+private:
+    enum { BucketCount = 13 };
+
+    quint32 m_requestsSent;
+    quint32 m_slowExchanges;
+    quint32 m_timeouts;
+    quint32 m_notificationsReceived;
+    quint32 m_notificationsDropped;
+
+    quint32 m_buckets[BucketCount];
+    quint32 m_samples;
+    qint64 m_maximumRoundTripTime;
+};
+
+#endif // COAPMETRICS_H
@@ -0,0 +1,189 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coapmulticastdiscovery.h"
+#include "extern-plugininfo.h"
+
+// Message header fields (RFC 7252 section 3)
+static const quint8 coapVersion = 1;
+static const quint8 coapTypeNonConfirmable = 1;
+static const quint8 coapCodeGet = 0x01;
+static const quint8 coapCodeContent = 0x45;
+static const quint8 coapOptionUriPath = 11;
+static const quint8 coapPayloadMarker = 0xff;
+
+CoapMulticastDiscovery::CoapMulticastDiscovery(QObject *parent) :
+    QObject(parent),
+    m_random(std::random_device()())
+{
+    m_socket = new QUdpSocket(this);
+    connect(m_socket, &QUdpSocket::readyRead, this, &CoapMulticastDiscovery::onReadyRead);
+
+    // Responses arriving after this window will be ignored
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &CoapMulticastDiscovery::onTimeout);
+}
+
+bool CoapMulticastDiscovery::isRunning() const
+{
+    return m_timer->isActive();
+}
+
+// Sends the discovery request and collects the responses for the given time in milliseconds
+bool CoapMulticastDiscovery::discover(const QHostAddress &address, quint16 port, int window)
+{
+    if (m_socket->state() != QAbstractSocket::BoundState) {
+        if (!m_socket->bind(QHostAddress::AnyIPv4, 0)) {
+            qCWarning(dcCoapClient) << "Could not bind discovery socket" << m_socket->errorString();
+            return false;
+        }
+
+        // Allows stand-in servers on this host to answer
+        m_socket->setSocketOption(QAbstractSocket::MulticastLoopbackOption, 1);
+    }
+
+    // Every discovery has its own token, so late responses of a previous one can be told apart.
+    // The generator is seeded from the system, so gateways don't share the token sequence.
+    m_token.clear();
+    quint32 token = m_random();
+    for (int i = 0; i < 4; i++) {
+        m_token.append(char((token >> (8 * i)) & 0xff));
+    }
+
+    m_servers.clear();
+
+    if (m_socket->writeDatagram(createRequest(), address, port) < 0) {
+        qCWarning(dcCoapClient) << "Could not send discovery request to" << address.toString() << m_socket->errorString();
+        return false;
+    }
+
+    qCDebug(dcCoapClient) << "Discover CoAP servers on" << address.toString() << port;
+    m_timer->start(window);
+    return true;
+}
+
+// Creates a non-confirmable GET /.well-known/core, multicast requests must not be confirmable
+QByteArray CoapMulticastDiscovery::createRequest() const
+{
+    QByteArray request;
+    quint16 messageId = qrand() & 0xffff;
+    request.append(char((coapVersion << 6) | (coapTypeNonConfirmable << 4) | m_token.size()));
+    request.append(char(coapCodeGet));
+    request.append(char(messageId >> 8));
+    request.append(char(messageId & 0xff));
+    request.append(m_token);
+
+    // Uri-Path: ".well-known", the second Uri-Path option has a delta of 0
+    request.append(char((coapOptionUriPath << 4) | 11));
+    request.append(".well-known");
+    request.append(char(4));
+    request.append("core");
+    return request;
+}
+
+// Returns the payload of a 2.05 Content response to our request
+bool CoapMulticastDiscovery::parseResponse(const QByteArray &datagram, QByteArray *payload) const
+{
+    if (datagram.size() < 4)
+        return false;
+
+    const uchar *data = reinterpret_cast<const uchar *>(datagram.constData());
+    int tokenLength = data[0] & 0x0f;
+    if ((data[0] >> 6) != coapVersion || data[1] != coapCodeContent || 4 + tokenLength > datagram.size())
+        return false;
+
+    if (datagram.mid(4, tokenLength) != m_token)
+        return false;
+
+    // Skip the options, we only need the payload
+    int position = 4 + tokenLength;
+    while (position < datagram.size() && data[position] != coapPayloadMarker) {
+        int delta = data[position] >> 4;
+        int length = data[position] & 0x0f;
+        position++;
+
+        if (delta == 13) {
+            position += 1;
+        } else if (delta == 14) {
+            position += 2;
+        }
+
+        if (length == 13) {
+            if (position >= datagram.size())
+                return false;
+            length = data[position] + 13;
+            position += 1;
+        } else if (length == 14) {
+            if (position + 1 >= datagram.size())
+                return false;
+            length = ((data[position] << 8) | data[position + 1]) + 269;
+            position += 2;
+        } else if (length == 15 || delta == 15) {
+            return false;
+        }
+
+        position += length;
+    }
+
+    // Options running past the end are a truncated or broken datagram. A response
+    // without links doesn't describe a server either.
+    if (position + 1 >= datagram.size())
+        return false;
+
+    *payload = datagram.mid(position + 1);
+    return true;
+}
+
+void CoapMulticastDiscovery::onReadyRead()
+{
+    while (m_socket->hasPendingDatagrams()) {
+        QByteArray datagram;
+        datagram.resize(int(m_socket->pendingDatagramSize()));
+
+        Server server;
+        m_socket->readDatagram(datagram.data(), datagram.size(), &server.address, &server.port);
+
+        if (!isRunning() || !parseResponse(datagram, &server.links))
+            continue;
+
+        // Servers listening on several interfaces answer more than once
+        bool duplicate = false;
+        foreach (const Server &discoveredServer, m_servers) {
+            if (discoveredServer.address == server.address && discoveredServer.port == server.port) {
+                duplicate = true;
+                break;
+            }
+        }
+
+        if (duplicate)
+            continue;
+
+        qCDebug(dcCoapClient) << "Discovered CoAP server" << server.address.toString() << server.port;
+        m_servers.append(server);
+    }
+}
+
+void CoapMulticastDiscovery::onTimeout()
+{
+    qCDebug(dcCoapClient) << "Discovery finished," << m_servers.count() << "CoAP server(s) found";
+    emit discoveryFinished(m_servers);
+    m_servers.clear();
+}
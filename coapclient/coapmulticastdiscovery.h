@@ -0,0 +1,65 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPMULTICASTDISCOVERY_H
+#define COAPMULTICASTDISCOVERY_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QTimer>
+
+#include <random>
+
+// Finds CoAP servers with one multicast GET /.well-known/core (RFC 7252 section 8)
+class CoapMulticastDiscovery : public QObject
+{
+    Q_OBJECT
+public:
+    struct Server {
+        QHostAddress address;
+        quint16 port;
+        QByteArray links;
+    };
+
+    explicit CoapMulticastDiscovery(QObject *parent = 0);
+
+    bool isRunning() const;
+    bool discover(const QHostAddress &address, quint16 port, int window);
+
+private:
+    QUdpSocket *m_socket;
+    QTimer *m_timer;
+    QByteArray m_token;
+    std::mt19937 m_random;
+    QList<Server> m_servers;
+
+    QByteArray createRequest() const;
+    bool parseResponse(const QByteArray &datagram, QByteArray *payload) const;
+
+signals:
+    void discoveryFinished(const QList<CoapMulticastDiscovery::Server> &servers);
+
+private slots:
+    void onReadyRead();
+    void onTimeout();
+};
+
+#endif // COAPMULTICASTDISCOVERY_H
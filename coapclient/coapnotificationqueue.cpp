@@ -0,0 +1,183 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coapnotificationqueue.h"
+#include "extern-plugininfo.h"
+
+// The observe sequence number has 24 bits, see RFC 7641 section 3.4
+static const int sequenceNumberLimit = 1 << 23;
+
+// After this time a notification is considered fresh regardless of its sequence number
+static const qint64 sequenceNumberLifetime = 128000;
+
+CoapNotificationQueue::CoapNotificationQueue(QObject *parent) :
+    QObject(parent),
+    m_window(0),
+    m_maximumQueueSize(1024)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &CoapNotificationQueue::onTimeout);
+
+    m_clock.start();
+}
+
+// Sets the time a notification will be held back waiting for newer values of the same resource
+void CoapNotificationQueue::setCoalescingWindow(int milliSeconds)
+{
+    m_window = milliSeconds;
+}
+
+// Sets how many resources can wait for delivery at the same time
+void CoapNotificationQueue::setMaximumQueueSize(int size)
+{
+    m_maximumQueueSize = size;
+}
+
+// Accepts the notifications of the resource from now on
+void CoapNotificationQueue::addResource(const QUrl &url)
+{
+    if (!m_resources.contains(url))
+        m_resources.insert(url, Resource());
+}
+
+// Forgets the resource and its queued notification
+void CoapNotificationQueue::removeResource(const QUrl &url)
+{
+    QHash<QUrl, Resource>::iterator it = m_resources.find(url);
+    if (it == m_resources.end())
+        return;
+
+    if (it.value().queued) {
+        QMultiMap<qint64, QUrl>::iterator entry = m_queue.begin();
+        while (entry != m_queue.end()) {
+            if (entry.value() == url) {
+                entry = m_queue.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    m_resources.erase(it);
+}
+
+// Returns false if the notification has been dropped
+bool CoapNotificationQueue::addNotification(const QUrl &url, int notificationNumber, const QByteArray &payload)
+{
+    // Notifications of resources nobody observes any more
+    QHash<QUrl, Resource>::iterator it = m_resources.find(url);
+    if (it == m_resources.end()) {
+        qCDebug(dcCoapClient) << "Drop notification of unobserved resource" << url.toString();
+        return false;
+    }
+
+    qint64 now = m_clock.elapsed();
+    Resource &resource = it.value();
+
+    // Drop notifications which are older than the last one we got
+    if (!isFresh(resource, notificationNumber, now)) {
+        qCDebug(dcCoapClient) << "Drop reordered notification" << notificationNumber << "of" << url.toString();
+        resource.reordered++;
+        return false;
+    }
+
+    resource.sequenceNumber = notificationNumber;
+    resource.timestamp = now;
+
+    if (m_window <= 0) {
+        emit notificationReady(url, payload);
+        return true;
+    }
+
+    // Latest value wins, the resource keeps its place in the queue
+    if (resource.queued) {
+        resource.payload = payload;
+        resource.coalesced++;
+        return true;
+    }
+
+    // Every resource has at most one entry in the queue, so a noisy resource can't starve the others
+    if (m_queue.count() >= m_maximumQueueSize) {
+        qCWarning(dcCoapClient) << "Notification queue full, drop notification of" << url.toString();
+        return false;
+    }
+
+    resource.payload = payload;
+    resource.queued = true;
+
+    // With a smaller window than before the new entry can be due first
+    qint64 dueTime = now + m_window;
+    m_queue.insert(dueTime, url);
+    if (!m_timer->isActive() || m_queue.firstKey() == dueTime)
+        m_timer->start(m_window);
+
+    return true;
+}
+
+quint32 CoapNotificationQueue::reorderedCount(const QUrl &url) const
+{
+    return m_resources.value(url).reordered;
+}
+
+quint32 CoapNotificationQueue::coalescedCount(const QUrl &url) const
+{
+    return m_resources.value(url).coalesced;
+}
+
+bool CoapNotificationQueue::isFresh(const Resource &resource, int notificationNumber, qint64 timestamp) const
+{
+    // First notification of this resource
+    if (resource.sequenceNumber < 0)
+        return true;
+
+    int last = resource.sequenceNumber;
+    if (last < notificationNumber && notificationNumber - last < sequenceNumberLimit)
+        return true;
+
+    // The sequence number wrapped around
+    if (last > notificationNumber && last - notificationNumber > sequenceNumberLimit)
+        return true;
+
+    return timestamp > resource.timestamp + sequenceNumberLifetime;
+}
+
+void CoapNotificationQueue::onTimeout()
+{
+    qint64 now = m_clock.elapsed();
+
+    // The due times are sorted, so only the expired entries will be visited
+    while (!m_queue.isEmpty() && m_queue.firstKey() <= now) {
+        QUrl url = m_queue.take(m_queue.firstKey());
+
+        QHash<QUrl, Resource>::iterator it = m_resources.find(url);
+        if (it == m_resources.end() || !it.value().queued)
+            continue;
+
+        QByteArray payload = it.value().payload;
+        it.value().payload.clear();
+        it.value().queued = false;
+
+        emit notificationReady(url, payload);
+    }
+
+    if (!m_queue.isEmpty())
+        m_timer->start(qMax<qint64>(0, m_queue.firstKey() - now));
+}
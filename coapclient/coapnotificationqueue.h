@@ -0,0 +1,79 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPNOTIFICATIONQUEUE_H
+#define COAPNOTIFICATIONQUEUE_H
+
+#include <QObject>
+#include <QHash>
+#include <QMultiMap>
+#include <QUrl>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// Filters reordered notifications of observed resources (RFC 7641) and
+// coalesces fast changing resources to their latest value.
+class CoapNotificationQueue : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoapNotificationQueue(QObject *parent = 0);
+
+    void setCoalescingWindow(int milliSeconds);
+    void setMaximumQueueSize(int size);
+
+    void addResource(const QUrl &url);
+    void removeResource(const QUrl &url);
+    bool addNotification(const QUrl &url, int notificationNumber, const QByteArray &payload);
+
+    quint32 reorderedCount(const QUrl &url) const;
+    quint32 coalescedCount(const QUrl &url) const;
+
+private:
+    struct Resource {
+        Resource() : sequenceNumber(-1), timestamp(0), queued(false), reordered(0), coalesced(0) { }
+        int sequenceNumber;
+        qint64 timestamp;
+        bool queued;
+        QByteArray payload;
+        quint32 reordered;
+        quint32 coalesced;
+    };
+
+    int m_window;
+    int m_maximumQueueSize;
+    QElapsedTimer m_clock;
+    QTimer *m_timer;
+
+    // The queued resources by due time. The window can change while entries are
+    // queued, so the insertion order is not the order of the due times.
+    QHash<QUrl, Resource> m_resources;
+    QMultiMap<qint64, QUrl> m_queue;
+
+    bool isFresh(const Resource &resource, int notificationNumber, qint64 timestamp) const;
+
+signals:
+    void notificationReady(const QUrl &url, const QByteArray &payload);
+
+private slots:
+    void onTimeout();
+};
+
+#endif // COAPNOTIFICATIONQUEUE_H
@@ -0,0 +1,103 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coaprttestimator.h"
+
+// Initial retransmission timeout (ACK_TIMEOUT, RFC 7252)
+static const double initialRto = 2000;
+
+// Bounds of the retransmission timeout
+static const double minimumRto = 100;
+static const double maximumRto = 32000;
+
+// Retransmission parameters of the CoAP socket (MAX_RETRANSMIT and ACK_RANDOM_FACTOR, RFC 7252)
+static const int maxRetransmit = 4;
+static const double ackRandomFactor = 1.5;
+
+CoapRttEstimator::CoapRttEstimator() :
+    m_lastSample(0),
+    m_rto(initialRto),
+    m_rtoTimestamp(0)
+{
+}
+
+// Adds the measured time between sending a request and receiving its response.
+// Returns true if the sample is ambiguous, see below.
+bool CoapRttEstimator::addSample(qint64 roundTripTime, qint64 timestamp)
+{
+    m_lastSample = roundTripTime;
+
+    // The socket doesn't tell us about retransmissions, but an exchange taking longer than
+    // the initial timeout may have been retransmitted. Those samples are ambiguous and go
+    // into the weak estimator, which has less influence on the overall timeout.
+    bool ambiguous = roundTripTime >= initialRto;
+    if (!ambiguous) {
+        double rto = m_strong.update(roundTripTime, 4);
+        m_rto = 0.5 * rto + 0.5 * m_rto;
+    } else {
+        double rto = m_weak.update(roundTripTime, 1);
+        m_rto = 0.25 * rto + 0.75 * m_rto;
+    }
+
+    m_rto = qBound(minimumRto, m_rto, maximumRto);
+    m_rtoTimestamp = timestamp;
+    return ambiguous;
+}
+
+// Returns the last measured round trip time in milliseconds
+qint64 CoapRttEstimator::roundTripTime() const
+{
+    return m_lastSample;
+}
+
+// Returns the current retransmission timeout in milliseconds
+qint64 CoapRttEstimator::retransmissionTimeout(qint64 timestamp)
+{
+    // Let estimates without fresh samples age towards the initial timeout
+    if (m_rto < 1000 && timestamp - m_rtoTimestamp > 16 * m_rto) {
+        m_rto = qMin(2 * m_rto, initialRto);
+        m_rtoTimestamp = timestamp;
+    } else if (m_rto > 3000 && timestamp - m_rtoTimestamp > 4 * m_rto) {
+        m_rto = (initialRto + m_rto) / 2;
+        m_rtoTimestamp = timestamp;
+    }
+
+    return qRound64(m_rto);
+}
+
+// Returns MAX_TRANSMIT_WAIT of the fixed retransmission schedule of the CoAP socket (RFC 7252)
+qint64 CoapRttEstimator::socketTransmitWait()
+{
+    return qRound64(initialRto * ((1 << (maxRetransmit + 1)) - 1) * ackRandomFactor);
+}
+
+double CoapRttEstimator::Estimator::update(double sample, int k)
+{
+    if (!valid) {
+        smoothedRtt = sample;
+        rttVariation = sample / 2;
+        valid = true;
+    } else {
+        rttVariation = 0.75 * rttVariation + 0.25 * qAbs(smoothedRtt - sample);
+        smoothedRtt = 0.875 * smoothedRtt + 0.125 * sample;
+    }
+
+    return smoothedRtt + k * rttVariation;
+}
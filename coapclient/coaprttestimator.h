@@ -0,0 +1,60 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPRTTESTIMATOR_H
+#define COAPRTTESTIMATOR_H
+
+#include <QtGlobal>
+
+// Round trip time estimation and adaptive retransmission timeout of one
+// CoAP server, following CoCoA (draft-ietf-core-cocoa). The CoAP socket of
+// libguh retransmits with the fixed RFC 7252 timeouts, so the estimate is
+// diagnostics only: it is published with the metrics and drives no timeout.
+class CoapRttEstimator
+{
+public:
+    CoapRttEstimator();
+
+    bool addSample(qint64 roundTripTime, qint64 timestamp);
+
+    qint64 roundTripTime() const;
+    qint64 retransmissionTimeout(qint64 timestamp);
+
+    static qint64 socketTransmitWait();
+
+private:
+    struct Estimator {
+        Estimator() : valid(false), smoothedRtt(0), rttVariation(0) { }
+        bool valid;
+        double smoothedRtt;
+        double rttVariation;
+
+        double update(double sample, int k);
+    };
+
+    Estimator m_strong;
+    Estimator m_weak;
+
+    qint64 m_lastSample;
+    double m_rto;
+    qint64 m_rtoTimestamp;
+};
+
+#endif // COAPRTTESTIMATOR_H
@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "coaptrafficrecorder.h"
+#include "extern-plugininfo.h"
+
+CoapTrafficRecorder::CoapTrafficRecorder() :
+    m_lastRecord(0)
+{
+}
+
+CoapTrafficRecorder::~CoapTrafficRecorder()
+{
+    stop();
+}
+
+bool CoapTrafficRecorder::isRecording() const
+{
+    return m_file.isOpen();
+}
+
+// Starts a new log, an existing file will be overwritten
+bool CoapTrafficRecorder::start(const QString &fileName)
+{
+    stop();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(dcCoapClient) << "Could not open capture file" << fileName << m_file.errorString();
+        return false;
+    }
+
+    qCDebug(dcCoapClient) << "Capture CoAP traffic to" << fileName;
+
+    m_stream.setDevice(&m_file);
+    m_stream << magic << version;
+
+    m_urls.clear();
+    m_clock.start();
+    m_lastRecord = 0;
+    return true;
+}
+
+void CoapTrafficRecorder::stop()
+{
+    if (!m_file.isOpen())
+        return;
+
+    m_stream.setDevice(0);
+    m_file.close();
+}
+
+void CoapTrafficRecorder::recordRequest(quint32 request, quint8 requestType, const QUrl &url, const QByteArray &payload)
+{
+    quint16 index = urlIndex(url);
+    writeHeader(RecordTypeRequest);
+    m_stream << request << requestType << index << payload;
+}
+
+void CoapTrafficRecorder::recordResponse(quint32 request, quint8 statusCode, quint8 error, const QByteArray &payload)
+{
+    writeHeader(RecordTypeResponse);
+    m_stream << request << statusCode << error << payload;
+}
+
+void CoapTrafficRecorder::recordTimeout(quint32 request)
+{
+    writeHeader(RecordTypeTimeout);
+    m_stream << request;
+}
+
+void CoapTrafficRecorder::recordNotification(const QUrl &url, quint32 notificationNumber, const QByteArray &payload)
+{
+    quint16 index = urlIndex(url);
+    writeHeader(RecordTypeNotification);
+    m_stream << index << notificationNumber << payload;
+}
+
+void CoapTrafficRecorder::writeHeader(RecordType type)
+{
+    // The time since the previous record keeps the timestamps small. It can hold 71 minutes,
+    // after longer pauses the absolute time is written first.
+    qint64 now = m_clock.nsecsElapsed() / 1000;
+    if (now - m_lastRecord > 0xffffffff) {
+        m_stream << quint8(RecordTypeTime) << quint32(0) << now;
+        m_lastRecord = now;
+    }
+
+    m_stream << quint8(type) << quint32(now - m_lastRecord);
+    m_lastRecord = now;
+}
+
+// Returns the index of the URL and writes its definition the first time it is used
+quint16 CoapTrafficRecorder::urlIndex(const QUrl &url)
+{
+    QHash<QUrl, quint16>::const_iterator it = m_urls.constFind(url);
+    if (it != m_urls.constEnd())
+        return it.value();
+
+    quint16 index = quint16(m_urls.count());
+    m_urls.insert(url, index);
+
+    writeHeader(RecordTypeUrl);
+    m_stream << index << url.toEncoded();
+    return index;
+}
@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COAPTRAFFICRECORDER_H
+#define COAPTRAFFICRECORDER_H
+
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QUrl>
+
+// Writes the CoAP exchanges of the plugin with timestamps to a compact binary log.
+//
+// File layout (QDataStream, big endian):
+//   quint32 magic, quint32 version
+//   records: quint8 type, quint32 microseconds since the previous record, type specific fields
+//
+// URLs are written once with a RecordTypeUrl record and afterwards referenced by their index.
+// If more time than the delta can hold passed since the previous record, a RecordTypeTime
+// record with the absolute time comes first and the following deltas refer to it.
+class CoapTrafficRecorder
+{
+public:
+    enum RecordType {
+        RecordTypeUrl = 0,              // quint16 url index, QByteArray url
+        RecordTypeRequest = 1,          // quint32 request, quint8 request type, quint16 url index, QByteArray payload
+        RecordTypeResponse = 2,         // quint32 request, quint8 status code, quint8 error, QByteArray payload
+        RecordTypeTimeout = 3,          // quint32 request
+        RecordTypeNotification = 4,     // quint16 url index, quint32 notification number, QByteArray payload
+        RecordTypeTime = 5              // qint64 microseconds since the start of the capture
+    };
+
+    static const quint32 magic = 0x43545243; // "CTRC"
+    static const quint32 version = 2;
+
+    CoapTrafficRecorder();
+    ~CoapTrafficRecorder();
+
+    bool isRecording() const;
+    bool start(const QString &fileName);
+    void stop();
+
+    void recordRequest(quint32 request, quint8 requestType, const QUrl &url, const QByteArray &payload);
+    void recordResponse(quint32 request, quint8 statusCode, quint8 error, const QByteArray &payload);
+    void recordTimeout(quint32 request);
+    void recordNotification(const QUrl &url, quint32 notificationNumber, const QByteArray &payload);
+
+private:
+    QFile m_file;
+    QDataStream m_stream;
+    QElapsedTimer m_clock;
+    qint64 m_lastRecord;
+    QHash<QUrl, quint16> m_urls;
+
+    void writeHeader(RecordType type);
+    quint16 urlIndex(const QUrl &url);
+};
+
+#endif // COAPTRAFFICRECORDER_H
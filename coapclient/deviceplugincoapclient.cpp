@@ -20,16 +20,62 @@
 
 #include "deviceplugincoapclient.h"
 #include "plugininfo.h"
+#include "plugintables.h"
+#include "guhsettings.h"
 
 #include <QJsonDocument>
 
-#include "coap/corelinkparser.h"
+#include "linkformatparser.h"
 
 // Note: You can find the documentation for this code here -> http://dev.guh.guru/write-plugins.html
 
+// Returns the name of the server endpoint the given URL belongs to
+static QString endpointName(const QUrl &url)
+{
+    return url.host() + ":" + QString::number(url.port(5683));
+}
+
 // The constructor of this device plugin.
-DevicePluginCoapClient::DevicePluginCoapClient()
+DevicePluginCoapClient::DevicePluginCoapClient() :
+    m_requestCounter(0)
 {
+    // All devices share one CoAP socket. Once the last device has been removed
+    // the socket will be closed after this idle period.
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(60000);
+    connect(m_idleTimer, &QTimer::timeout, this, &DevicePluginCoapClient::onIdleTimeout);
+
+    // Queued requests will be sent once the event loop is back, so a burst of actions can be batched
+    m_sendTimer = new QTimer(this);
+    m_sendTimer->setSingleShot(true);
+    m_sendTimer->setInterval(0);
+    connect(m_sendTimer, &QTimer::timeout, this, &DevicePluginCoapClient::onSendTimeout);
+
+    // Periodically fail requests the server never answered
+    m_timeoutTimer = new QTimer(this);
+    m_timeoutTimer->setInterval(1000);
+    connect(m_timeoutTimer, &QTimer::timeout, this, &DevicePluginCoapClient::onTimeoutCheck);
+
+    // Publishes the transport metrics as device states
+    m_metricsTimer = new QTimer(this);
+    connect(m_metricsTimer, &QTimer::timeout, this, &DevicePluginCoapClient::onMetricsTimeout);
+
+    m_clock.start();
+
+    // Drops reordered notifications and limits the event rate of fast changing resources
+    m_notificationQueue = new CoapNotificationQueue(this);
+    connect(m_notificationQueue, &CoapNotificationQueue::notificationReady, this, &DevicePluginCoapClient::onNotificationReady);
+
+    // Remember the discovered resources, so devices can be set up without network after a restart
+    m_discoveryCache = new CoapDiscoveryCache(GuhSettings::settingsPath() + "/coapclient-discovery.cache", this);
+
+    // Remember the last values of the resources, so devices have valid states right after a restart
+    m_stateSnapshot = new StateSnapshot(GuhSettings::settingsPath() + "/coapclient-states.snapshot", dcCoapClient, this);
+
+    // Finds all CoAP servers of the network with one request
+    m_multicastDiscovery = new CoapMulticastDiscovery(this);
+    connect(m_multicastDiscovery, &CoapMulticastDiscovery::discoveryFinished, this, &DevicePluginCoapClient::onDiscoveryFinished);
 }
 
 DeviceManager::HardwareResources DevicePluginCoapClient::requiredHardware() const
@@ -37,46 +83,84 @@ DeviceManager::HardwareResources DevicePluginCoapClient::requiredHardware() cons
     return DeviceManager::HardwareResourceNone;
 }
 
+// This method will be called whenever a client wants to discover CoAP servers
+DeviceManager::DeviceError DevicePluginCoapClient::discoverDevices(const DeviceClassId &deviceClassId, const ParamList &params)
+{
+    Q_UNUSED(params)
+
+    if (deviceClassId != infoDeviceClassId)
+        return DeviceManager::DeviceErrorDeviceClassNotFound;
+
+    // A running discovery will report its results to this request as well
+    if (m_multicastDiscovery->isRunning())
+        return DeviceManager::DeviceErrorAsync;
+
+    QHostAddress address(configValue("discovery address").toString());
+    quint16 port = configValue("discovery port").toUInt();
+    if (!m_multicastDiscovery->discover(address, port, configValue("discovery window").toInt()))
+        return DeviceManager::DeviceErrorHardwareNotAvailable;
+
+    // The discovered devices will be emitted once the discovery window is over
+    return DeviceManager::DeviceErrorAsync;
+}
+
 DeviceManager::DeviceSetupStatus DevicePluginCoapClient::setupDevice(Device *device)
 {
-    // Check if we already have a coap client device
-    if (!myDevices().isEmpty()) {
-        qCWarning(dcCoapClient) << "There is already a configured coap client device";
-        return DeviceManager::DeviceSetupStatusFailure;
+    qCDebug(dcCoapClient) << "Setting up a new device:" << device->name() << device->params();
+
+    // Capture the CoAP traffic if requested
+    QString captureFile = configValue("capture file").toString();
+    if (captureFile.isEmpty()) {
+        m_trafficRecorder.stop();
+    } else if (!m_trafficRecorder.isRecording()) {
+        m_trafficRecorder.start(captureFile);
     }
 
-    qCDebug(dcCoapClient) << "Setting up a new device:" << device->name() << device->params();
+    // A new device keeps the CoAP socket
+    m_idleTimer->stop();
+
+    // The limits of the notification queue apply to the notifications from now on
+    m_notificationQueue->setCoalescingWindow(configValue("notification coalescing window").toInt());
+    m_notificationQueue->setMaximumQueueSize(configValue("max queued notifications").toInt());
+
+    // Start publishing the metrics with the first device
+    if (!m_metricsTimer->isActive() && configValue("metrics interval").toInt() > 0)
+        m_metricsTimer->start(configValue("metrics interval").toInt() * 1000);
 
     // Verify the given URL
-    QUrl url(device->paramValue("url").toString());
+    QUrl url(InfoDeviceParams::fromDevice(device).url);
     if (url.scheme() != "coap") {
         qCWarning(dcCoapClient) << "Invalid URL scheme" << url.scheme() << " != " << "coap";
         return DeviceManager::DeviceSetupStatusFailure;
     }
 
-    m_device = device;
-
-    // Create new CoAP client if there isn't one yet
-    if (m_coap.isNull()) {
-        m_coap = new Coap(this);
-        connect(m_coap, &Coap::replyFinished, this, &DevicePluginCoapClient::onReplyFinished);
-        connect(m_coap, &Coap::notificationReceived, this, &DevicePluginCoapClient::onNotificationReceived);
+    // Start from the last known values until the server sends new ones
+    QList<StateTypeId> stateTypeIds;
+    foreach (const StateField &field, infoStateFields()) {
+        stateTypeIds.append(field.stateTypeId);
     }
+    m_stateSnapshot->restore(device, stateTypeIds);
+    m_stateSnapshot->track(device, stateTypeIds);
 
     // Discover the CoAP server
     url.setPath("/.well-known/core");
-    CoapReply *reply = m_coap->get(CoapRequest(url));
 
-    // Check imediatly if the there occured any error
-    if (reply->error() != CoapReply::NoError) {
-        qCWarning(dcCoapClient) << "Could not discover CoAP server:" << reply->errorString();
-        reply->deleteLater();
-        m_coap->deleteLater();
-        return DeviceManager::DeviceSetupStatusFailure;
+    // If we know the resources of this server already, the setup can finish right away
+    m_discoveryCache->setLifetime(configValue("discovery cache lifetime").toInt());
+    if (m_discoveryCache->isFresh(url)) {
+        qCDebug(dcCoapClient) << "Using cached resource discovery of" << url.toString();
+        printLinks(m_discoveryCache->links(url));
+
+        // Revalidate the cached resources in the background
+        enqueueRequest(RequestTypeRevalidate, device, url);
+        return DeviceManager::DeviceSetupStatusSuccess;
     }
 
-    // Store the reply and device until we get our asynchronous response
-    m_discoverReplies.insert(reply, device);
+    // Store the request and device until we get our asynchronous response
+    if (!enqueueRequest(RequestTypeDiscover, device, url)) {
+        qCWarning(dcCoapClient) << "Could not discover CoAP server: too many queued requests";
+        return DeviceManager::DeviceSetupStatusFailure;
+    }
 
     // Tell the DeviceManager that the setup result will be communicated later
     return DeviceManager::DeviceSetupStatusAsync;
@@ -84,11 +168,43 @@ DeviceManager::DeviceSetupStatus DevicePluginCoapClient::setupDevice(Device *dev
 
 void DevicePluginCoapClient::deviceRemoved(Device *device)
 {
-    // Prevent the unused variable warning
-    Q_UNUSED(device)
+    m_stateSnapshot->remove(device->id());
+
+    // Drop the queued requests of this device
+    QHash<QString, Endpoint>::iterator endpoint;
+    for (endpoint = m_endpoints.begin(); endpoint != m_endpoints.end(); ++endpoint) {
+        QQueue<PendingRequest>::iterator it = endpoint.value().queue.begin();
+        while (it != endpoint.value().queue.end()) {
+            if (it->device == device) {
+                it = endpoint.value().queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
 
-    // Delete the CoAP socket if not longer needed
-    m_coap->deleteLater();
+    // Forget the device of the requests already sent. The replies will
+    // still free their slot in the send window once they are finished.
+    QHash<CoapReply *, PendingRequest>::iterator it;
+    for (it = m_pendingRequests.begin(); it != m_pendingRequests.end(); ++it) {
+        if (it.value().device == device) {
+            it.value().device = 0;
+            it.value().actionIds.clear();
+        }
+    }
+
+    foreach (const QUrl &url, m_observedResources.keys()) {
+        unsubscribe(device, url);
+    }
+
+    // Keep the CoAP socket as long as there are other devices using it
+    foreach (Device *configuredDevice, myDevices()) {
+        if (configuredDevice != device)
+            return;
+    }
+
+    // Delete the CoAP socket lazily, a new device could show up soon
+    m_idleTimer->start();
 }
 
 // This method will be called whenever a client or the rule engine wants to execute an action for the given device.
@@ -96,55 +212,88 @@ DeviceManager::DeviceError DevicePluginCoapClient::executeAction(Device *device,
 {
     qCDebug(dcCoapClient) << "Execute action" << action.id() << action.params();
 
-    // check if the requested action is our "upload" action ...
-    if (action.actionTypeId() == notificationsActionTypeId) {
+    // Look up the execute<ActionType>() method for the DeviceClassId and ActionTypeId
+    ActionDispatch<DevicePluginCoapClient>::Handler handler = ActionDispatch<DevicePluginCoapClient>::handler(device->deviceClassId(), action.actionTypeId());
+    if (!handler)
+        return DeviceManager::DeviceErrorActionTypeNotFound;
 
-        // observe resource (enable notifications)
-        QUrl url(device->paramValue("url").toString());
-        url.setPath(url.path().append("/obs"));
-
-        if (action.param("notification").value().toBool()) {
-            qCDebug(dcCoapClient) << "Enable notification on resource" << url.toString();
-            CoapReply *reply = m_coap->enableResourceNotifications(CoapRequest(url));
-            m_asyncActions.insert(reply, action.id());
-            m_notificationEnableReplies.insert(reply, device);
-        } else {
-            qCDebug(dcCoapClient) << "Disable notification on resource" << url.toString();
-            CoapReply *reply = m_coap->disableNotifications(CoapRequest(url));
-            m_asyncActions.insert(reply, action.id());
-            m_notificationDisableReplies.insert(reply, device);
-        }
+    return (this->*handler)(device, action);
+}
 
-        // Tell the DeviceManager that this is an async action and the
-        // result of the execution will be emitted later.
-        return DeviceManager::DeviceErrorAsync;
+// The action of the writable "notifications" state
+DeviceManager::DeviceError DevicePluginCoapClient::executeNotifications(Device *device, const Action &action)
+{
+    // observe resource (enable notifications)
+    QUrl url(InfoDeviceParams::fromDevice(device).url);
+    url.setPath(url.path().append("/obs"));
 
-    } else if (action.actionTypeId() == uploadActionTypeId) {
+    if (NotificationsParams::fromAction(action).notification) {
+        qCDebug(dcCoapClient) << "Enable notification on resource" << url.toString();
 
-        // Define the URL for uploading the message (POST)
-        QUrl url(device->paramValue("url").toString());
-        url.setPath(url.path().append("/test"));
+        // Tell the DeviceManager if this is an async action and the
+        // result of the execution will be emitted later.
+        return subscribe(device, url, action.id());
+    }
 
-        // Upload the message (POST)
-        CoapReply *reply = m_coap->post(CoapRequest(url), action.param("message").value().toString().toUtf8());
-        m_uploadReplies.append(reply);
-        m_asyncActions.insert(reply, action.id());
+    qCDebug(dcCoapClient) << "Disable notification on resource" << url.toString();
+    unsubscribe(device, url);
+    return DeviceManager::DeviceErrorNoError;
+}
 
-        // Tell the DeviceManager that this is an async action and the
-        // result of the execution will be emitted later.
-        return DeviceManager::DeviceErrorAsync;
+// The "upload" action
+DeviceManager::DeviceError DevicePluginCoapClient::executeUpload(Device *device, const Action &action)
+{
+    // Define the URL for uploading the message (POST)
+    QUrl url(InfoDeviceParams::fromDevice(device).url);
+    url.setPath(url.path().append("/test"));
+
+    // Messages which don't fit into one datagram will be sent block-wise (Block1, RFC 7959)
+    // by the CoAP socket. Limit the size, the whole message stays in memory until it is sent.
+    QByteArray message = UploadParams::fromAction(action).message.toUtf8();
+    if (message.size() > configValue("max upload size").toInt()) {
+        qCWarning(dcCoapClient) << "Message too large for upload:" << message.size() << "bytes";
+        return DeviceManager::DeviceErrorInvalidParameter;
     }
 
-    // ...otherwise the ActionType does not exist
-    return DeviceManager::DeviceErrorActionTypeNotFound;
+    // Upload the message (POST)
+    if (!enqueueRequest(RequestTypeUpload, device, url, message, action.id()))
+        return DeviceManager::DeviceErrorHardwareNotAvailable;
+
+    // Tell the DeviceManager that this is an async action and the
+    // result of the execution will be emitted later.
+    return DeviceManager::DeviceErrorAsync;
 }
 
 // This slot will be called whenever a reply from the CoAP socket has finished
 void DevicePluginCoapClient::onReplyFinished(CoapReply *reply)
 {
-    // Now check which reply this was by checking in which Hash it can be found
-    if (m_discoverReplies.keys().contains(reply)) {
-        Device *device = m_discoverReplies.take(reply);
+    // Replies which timed out are not pending any more
+    if (!m_pendingRequests.contains(reply)) {
+        reply->deleteLater();
+        return;
+    }
+
+    PendingRequest request = m_pendingRequests.value(reply);
+    removePendingRequest(reply);
+
+    if (m_trafficRecorder.isRecording())
+        m_trafficRecorder.recordResponse(request.id, reply->statusCode(), reply->error(), reply->payload());
+
+    // Every answer of the server updates its round trip time estimation
+    if (reply->error() == CoapReply::NoError)
+        updateRoundTripTime(request);
+
+    // The device has been removed in the meantime. Observe requests
+    // are shared by all devices subscribed to the resource.
+    if (!request.device && request.type != RequestTypeEnableNotifications && request.type != RequestTypeDisableNotifications) {
+        reply->deleteLater();
+        return;
+    }
+
+    Device *device = request.device;
+
+    // Now check which reply this was by the type of the request
+    if (request.type == RequestTypeDiscover) {
 
         // Verify there where no reply errors (transport layer)
         if (reply->error() != CoapReply::NoError) {
@@ -164,26 +313,34 @@ void DevicePluginCoapClient::onReplyFinished(CoapReply *reply)
             return;
         }
 
-        qCDebug(dcCoapClient) << "Discovered successfully the resources";
+        processDiscoveryResponse(request, reply->payload());
+
+    } else if (request.type == RequestTypeRevalidate) {
 
-        // Print the CoRE links we got from the server resource discovery
-        CoreLinkParser parser(reply->payload());
-        foreach (const CoreLink &link, parser.links()) {
-            qCDebug(dcCoapClient) << link << endl;
+        // The device is already set up, keep the cached resources if the server didn't answer
+        if (reply->error() != CoapReply::NoError) {
+            qCWarning(dcCoapClient) << "CoAP resource revalidation reply error" << reply->errorString();
+            reply->deleteLater();
+            return;
         }
 
-        // Tell the device manager that the device setup finished successfully
-        emit deviceSetupFinished(device, DeviceManager::DeviceSetupStatusSuccess);
+        // The server answered, but doesn't offer the resources any more
+        if (reply->statusCode() != CoapPdu::Content) {
+            qCWarning(dcCoapClient) << "CoAP revalidation status code:" << reply;
+            m_discoveryCache->remove(request.url);
+            reply->deleteLater();
+            return;
+        }
 
-    } else if (m_notificationEnableReplies.keys().contains(reply)) {
-        Device *device = m_notificationEnableReplies.take(reply);
-        ActionId actionId = m_asyncActions.take(reply);
+        processDiscoveryResponse(request, reply->payload());
+
+    } else if (request.type == RequestTypeEnableNotifications) {
 
         // Verify there where no reply errors (transport layer)
         if (reply->error() != CoapReply::NoError) {
             qCWarning(dcCoapClient) << "CoAP enable observe resource reply error" << reply->errorString();
             // Something went wrong. Tell the devicemanager that the action finished with error.
-            emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
+            finishPendingRequest(request, replyError(reply));
             reply->deleteLater();
             return;
         }
@@ -192,28 +349,23 @@ void DevicePluginCoapClient::onReplyFinished(CoapReply *reply)
         if (reply->statusCode() != CoapPdu::Content) {
             qCWarning(dcCoapClient) << "CoAP enable observe status code:" << reply;
             // Something went wrong. Tell the devicemanager that the action finished with error.
-            emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
+            finishPendingRequest(request, DeviceManager::DeviceErrorHardwareFailure);
             reply->deleteLater();
             return;
         }
 
         qCDebug(dcCoapClient) << "Enabled successfully notifications" << reply;
 
-        // Set the corresping state
-        device->setStateValue(notificationsStateTypeId, true);
+        // Tell the device manager that the waiting action executions finished successfully
+        finishPendingRequest(request, DeviceManager::DeviceErrorNoError);
 
-        // Tell the device manager that the action execution finished successfully
-        emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorNoError);
-
-    } else if (m_notificationDisableReplies.keys().contains(reply)) {
-        Device *device = m_notificationDisableReplies.take(reply);
-        ActionId actionId = m_asyncActions.take(reply);
+    } else if (request.type == RequestTypeDisableNotifications) {
 
         // Verify there where no reply errors (transport layer)
         if (reply->error() != CoapReply::NoError) {
             qCWarning(dcCoapClient) << "CoAP disable observe resource reply error" << reply->errorString();
             // Something went wrong. Tell the devicemanager that the action finished with error.
-            emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
+            finishPendingRequest(request, replyError(reply));
             reply->deleteLater();
             return;
         }
@@ -222,27 +374,22 @@ void DevicePluginCoapClient::onReplyFinished(CoapReply *reply)
         if (reply->statusCode() != CoapPdu::Content) {
             qCWarning(dcCoapClient) << "CoAP disable observe status code:" << reply;
             // Something went wrong. Tell the devicemanager that the action finished with error.
-            emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
+            finishPendingRequest(request, DeviceManager::DeviceErrorHardwareFailure);
             reply->deleteLater();
             return;
         }
 
         qCDebug(dcCoapClient) << "Disabled successfully notifications" << reply;
 
-        // Set the corresping state
-        device->setStateValue(notificationsStateTypeId, false);
+        finishPendingRequest(request, DeviceManager::DeviceErrorNoError);
 
-        // Tell the device manager that the action execution finished successfully
-        emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorNoError);
-
-    } else if (m_uploadReplies.contains(reply)) {
-        ActionId actionId = m_asyncActions.take(reply);
+    } else if (request.type == RequestTypeUpload) {
 
         // Verify there where no reply errors (transport layer)
         if (reply->error() != CoapReply::NoError) {
             qCWarning(dcCoapClient) << "CoAP upload reply error" << reply->errorString();
             // Something went wrong. Tell the devicemanager that the action finished with error.
-            emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
+            finishPendingRequest(request, replyError(reply));
             reply->deleteLater();
             return;
         }
@@ -251,15 +398,15 @@ void DevicePluginCoapClient::onReplyFinished(CoapReply *reply)
         if (reply->statusCode() != CoapPdu::Created) {
             qCWarning(dcCoapClient) << "CoAP upload status code:" << reply;
             // Something went wrong. Tell the devicemanager that the action finished with error.
-            emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
+            finishPendingRequest(request, DeviceManager::DeviceErrorHardwareFailure);
             reply->deleteLater();
             return;
         }
 
-        qCDebug(dcCoapClient) << "Uploaded message successfully" << reply;
+        qCDebug(dcCoapClient) << "Uploaded" << request.actionIds.count() << "message(s) successfully" << reply;
 
         // Tell the device manager that the action execution finished successfully
-        emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorNoError);
+        finishPendingRequest(request, DeviceManager::DeviceErrorNoError);
 
     }
 
@@ -270,14 +417,502 @@ void DevicePluginCoapClient::onReplyFinished(CoapReply *reply)
 // This method will be called if the CoAP socket received a notification from an observed resource
 void DevicePluginCoapClient::onNotificationReceived(const CoapObserveResource &resource, const int &notificationNumber, const QByteArray &payload)
 {
-    qCDebug(dcCoapClient) << "Got notification from observed resource" << notificationNumber << resource.url().path() << endl << payload;
+    qCDebug(dcCoapClient) << "Got notification from observed resource" << notificationNumber << resource.url().path() << payload.size() << "bytes";
+
+    if (m_trafficRecorder.isRecording())
+        m_trafficRecorder.recordNotification(resource.url(), notificationNumber, payload);
+
+    bool accepted = m_notificationQueue->addNotification(resource.url(), notificationNumber, payload);
+
+    QHash<QUrl, ObservedResource>::const_iterator it = m_observedResources.constFind(resource.url());
+    if (it != m_observedResources.constEnd())
+        m_endpoints[it.value().endpoint].metrics.addNotification(!accepted);
+}
+
+// This slot will be called once a notification passed the reordering and coalescing checks
+void DevicePluginCoapClient::onNotificationReady(const QUrl &url, const QByteArray &payload)
+{
+    // Find the devices observing this resource
+    QHash<QUrl, ObservedResource>::const_iterator it = m_observedResources.constFind(url);
+    if (it == m_observedResources.constEnd() || it.value().devices.isEmpty()) {
+        qCWarning(dcCoapClient) << "Got notification for unknown resource" << url.toString();
+        return;
+    }
+
+    // SenML payloads update the states mapped with "sourceField" in the plugin JSON file.
+    // The fields are matched against the record names without the base name of the server.
+    SenmlDecoder::Format format = SenmlDecoder::detectFormat(payload);
+    if (format != SenmlDecoder::FormatUnknown) {
+        QList<SenmlDecoder::Record> records;
+        if (SenmlDecoder::decode(payload, format, &records)) {
+            const QHash<QByteArray, StateField> &fields = infoStateFields();
+            foreach (const SenmlDecoder::Record &record, records) {
+                QHash<QByteArray, StateField>::const_iterator field = fields.constFind(record.name);
+                if (field == fields.constEnd())
+                    continue;
+
+                QVariant value = record.value;
+                if (!value.convert(field.value().type)) {
+                    qCWarning(dcCoapClient) << "Invalid value for SenML record" << record.baseName + record.name << record.value;
+                    continue;
+                }
+
+                foreach (Device *device, it.value().devices) {
+                    device->setStateValue(field.value().stateTypeId, value);
+                }
+            }
+            return;
+        }
+
+        qCWarning(dcCoapClient) << "Could not decode SenML notification of" << url.toString();
+    }
 
     // Create the params for the event
     ParamList paramList;
     paramList.append(Param("time", payload));
 
-    // Tell the device manager we got an event
-    emitEvent(Event(timeEventTypeId, m_device->id(), paramList));
+    // Tell the device manager we got an event for each subscribed device
+    foreach (Device *device, it.value().devices) {
+        emitEvent(Event(timeEventTypeId, device->id(), paramList));
+    }
 }
 
+// Returns the shared CoAP socket and creates it if there isn't one yet
+Coap *DevicePluginCoapClient::coap()
+{
+    // The idle timer keeps running, the requests left after the last device was removed
+    // (e.g. disabling its notifications) must not keep the socket alive
+    if (m_coap.isNull()) {
+        qCDebug(dcCoapClient) << "Create CoAP socket";
+        m_coap = new Coap(this);
+        connect(m_coap, &Coap::replyFinished, this, &DevicePluginCoapClient::onReplyFinished);
+        connect(m_coap, &Coap::notificationReceived, this, &DevicePluginCoapClient::onNotificationReceived);
+    }
 
+    return m_coap;
+}
+
+// Queues a request for the server of the given URL. Returns false if the queue of the server is full.
+bool DevicePluginCoapClient::enqueueRequest(RequestType type, Device *device, const QUrl &url, const QByteArray &payload, const ActionId &actionId)
+{
+    QString name = endpointName(url);
+    Endpoint &endpoint = m_endpoints[name];
+
+    // Merge small uploads to the same resource into the last queued upload if the application allows it
+    int batchSize = configValue("upload batch size").toInt();
+    if (type == RequestTypeUpload && batchSize > 0 && !endpoint.queue.isEmpty()) {
+        PendingRequest &last = endpoint.queue.last();
+        if (last.type == RequestTypeUpload && last.device == device && last.url == url
+                && last.payload.size() + payload.size() + 1 <= batchSize) {
+            last.payload.append('\n');
+            last.payload.append(payload);
+            last.actionIds.append(actionId);
+            return true;
+        }
+    }
+
+    if (endpoint.queue.count() >= configValue("max queued requests").toInt())
+        return false;
+
+    PendingRequest request;
+    request.type = type;
+    request.device = device;
+    request.endpoint = name;
+    request.url = url;
+    request.payload = payload;
+    if (!actionId.isNull())
+        request.actionIds.append(actionId);
+
+    request.id = 0;
+    request.sentTime = 0;
+    request.deadline = 0;
+    endpoint.queue.enqueue(request);
+
+    m_sendTimer->start();
+    return true;
+}
+
+// Sends queued requests of the given server as long as its send window has free slots
+void DevicePluginCoapClient::sendQueuedRequests(const QString &endpointName)
+{
+    Endpoint &endpoint = m_endpoints[endpointName];
+    int windowSize = qMax(1, configValue("max requests in flight").toInt());
+
+    while (endpoint.requestsInFlight < windowSize && !endpoint.queue.isEmpty()) {
+        PendingRequest request = endpoint.queue.dequeue();
+
+        CoapReply *reply = 0;
+        switch (request.type) {
+        case RequestTypeDiscover:
+        case RequestTypeRevalidate:
+            reply = coap()->get(CoapRequest(request.url));
+            break;
+        case RequestTypeEnableNotifications:
+            reply = coap()->enableResourceNotifications(CoapRequest(request.url));
+            break;
+        case RequestTypeDisableNotifications:
+            reply = coap()->disableNotifications(CoapRequest(request.url));
+            break;
+        case RequestTypeUpload:
+            // The payload is shared with the request, the socket slices the blocks from it
+            reply = coap()->post(CoapRequest(request.url), request.payload);
+            break;
+        }
+
+        // Check imediatly if the there occured any error
+        if (reply->error() != CoapReply::NoError) {
+            qCWarning(dcCoapClient) << "Could not send CoAP request to" << request.url.toString() << reply->errorString();
+            reply->deleteLater();
+            finishPendingRequest(request, replyError(reply));
+            continue;
+        }
+
+        request.id = m_requestCounter++;
+        if (m_trafficRecorder.isRecording())
+            m_trafficRecorder.recordRequest(request.id, request.type, request.url, request.payload);
+
+        // The payload is not needed any more once it has been sent
+        request.payload.clear();
+
+        // Give up once the socket has retransmitted the request for the last time. The socket uses
+        // the fixed RFC 7252 timeouts, regardless of the estimated timeout of the server.
+        request.sentTime = m_clock.elapsed();
+        request.deadline = request.sentTime + CoapRttEstimator::socketTransmitWait();
+
+        endpoint.requestsInFlight++;
+        endpoint.metrics.addRequestSent();
+        m_pendingRequests.insert(reply, request);
+        m_requestDeadlines.insert(request.deadline, reply);
+    }
+
+    if (!m_pendingRequests.isEmpty() && !m_timeoutTimer->isActive())
+        m_timeoutTimer->start();
+}
+
+// Removes a sent request and frees its slot in the send window of the server
+void DevicePluginCoapClient::removePendingRequest(CoapReply *reply)
+{
+    PendingRequest request = m_pendingRequests.take(reply);
+    m_requestDeadlines.remove(request.deadline, reply);
+
+    m_endpoints[request.endpoint].requestsInFlight--;
+    sendQueuedRequests(request.endpoint);
+}
+
+// Finishes a discovery or revalidation with the link format payload of the server
+void DevicePluginCoapClient::processDiscoveryResponse(const PendingRequest &request, const QByteArray &payload)
+{
+    m_discoveryCache->insert(request.url, payload);
+
+    if (request.type == RequestTypeRevalidate) {
+        qCDebug(dcCoapClient) << "Revalidated successfully the resources of" << request.device->name();
+        return;
+    }
+
+    qCDebug(dcCoapClient) << "Discovered successfully the resources";
+    printLinks(payload);
+
+    // Tell the device manager that the device setup finished successfully
+    emit deviceSetupFinished(request.device, DeviceManager::DeviceSetupStatusSuccess);
+}
+
+// Prints the CoRE links of a resource discovery
+void DevicePluginCoapClient::printLinks(const QByteArray &payload) const
+{
+    if (!dcCoapClient().isDebugEnabled())
+        return;
+
+    LinkFormatParser parser(payload);
+    LinkFormatParser::Link link;
+    while (parser.next(&link)) {
+        qCDebug(dcCoapClient) << link.path() << link.attributes();
+    }
+}
+
+// Adds the round trip time of a finished request to the estimation of its server
+void DevicePluginCoapClient::updateRoundTripTime(const PendingRequest &request)
+{
+    qint64 now = m_clock.elapsed();
+    Endpoint &endpoint = m_endpoints[request.endpoint];
+
+    // The current values will be published with the other metrics. Exchanges longer than
+    // the initial timeout are counted, they may include retransmissions of the socket.
+    if (endpoint.rttEstimator.addSample(now - request.sentTime, now))
+        endpoint.metrics.addSlowExchange();
+
+    endpoint.metrics.addRoundTripTime(now - request.sentTime);
+}
+
+// Returns the device error for a reply which failed on the transport layer
+DeviceManager::DeviceError DevicePluginCoapClient::replyError(CoapReply *reply)
+{
+    if (reply->error() == CoapReply::TimeoutError)
+        return DeviceManager::DeviceErrorTimeout;
+
+    return DeviceManager::DeviceErrorHardwareFailure;
+}
+
+// Reports the result of a request to the device manager
+void DevicePluginCoapClient::finishPendingRequest(const PendingRequest &request, DeviceManager::DeviceError error)
+{
+    // Observe requests finish the actions of all devices waiting for the resource
+    if (request.type == RequestTypeEnableNotifications || request.type == RequestTypeDisableNotifications) {
+        finishObserveRequest(request, error);
+        return;
+    }
+
+    // The device has been removed in the meantime
+    if (!request.device)
+        return;
+
+    if (request.type == RequestTypeDiscover) {
+        emit deviceSetupFinished(request.device, error == DeviceManager::DeviceErrorNoError ? DeviceManager::DeviceSetupStatusSuccess : DeviceManager::DeviceSetupStatusFailure);
+    } else if (request.type == RequestTypeRevalidate) {
+        // The device is already set up with the cached resources
+        return;
+    } else {
+        foreach (const ActionId &actionId, request.actionIds) {
+            emit actionExecutionFinished(actionId, error);
+        }
+    }
+}
+
+// Subscribes the device to the notifications of the resource. Only the first subscriber will observe the resource on the server.
+DeviceManager::DeviceError DevicePluginCoapClient::subscribe(Device *device, const QUrl &url, const ActionId &actionId)
+{
+    ObservedResource &resource = m_observedResources[url];
+    if (resource.endpoint.isEmpty())
+        resource.endpoint = endpointName(url);
+
+    // The resource is already observed, the device just gets the notifications as well
+    if (resource.state == ObserveStateActive) {
+        if (!resource.devices.contains(device))
+            resource.devices.append(device);
+
+        device->setStateValue(notificationsStateTypeId, true);
+        return DeviceManager::DeviceErrorNoError;
+    }
+
+    // Enable the observation on the server, unless that is already in progress. If it is being
+    // disabled right now, it will be enabled again once that is done.
+    if (resource.state == ObserveStateInactive) {
+        if (!enqueueRequest(RequestTypeEnableNotifications, 0, url)) {
+            m_observedResources.remove(url);
+            return DeviceManager::DeviceErrorHardwareNotAvailable;
+        }
+        resource.state = ObserveStateEnabling;
+    }
+
+    resource.waitingActions.append(qMakePair(device, actionId));
+    return DeviceManager::DeviceErrorAsync;
+}
+
+// Unsubscribes the device from the notifications of the resource. The last subscriber disables the observation on the server.
+void DevicePluginCoapClient::unsubscribe(Device *device, const QUrl &url)
+{
+    device->setStateValue(notificationsStateTypeId, false);
+
+    QHash<QUrl, ObservedResource>::iterator it = m_observedResources.find(url);
+    if (it == m_observedResources.end())
+        return;
+
+    ObservedResource &resource = it.value();
+    resource.devices.removeAll(device);
+
+    // The enable actions of the device still waiting are cancelled, there is no transport error to report
+    for (int i = resource.waitingActions.count() - 1; i >= 0; i--) {
+        if (resource.waitingActions.at(i).first == device) {
+            emit actionExecutionFinished(resource.waitingActions.takeAt(i).second, DeviceManager::DeviceErrorHardwareFailure);
+        }
+    }
+
+    if (resource.state != ObserveStateActive || !resource.devices.isEmpty())
+        return;
+
+    // The last subscriber is gone, stop the notifications on the server
+    m_notificationQueue->removeResource(url);
+    if (enqueueRequest(RequestTypeDisableNotifications, 0, url)) {
+        resource.state = ObserveStateDisabling;
+    } else {
+        m_observedResources.erase(it);
+    }
+}
+
+// Updates the observed resource and its waiting devices once the server answered an observe request
+void DevicePluginCoapClient::finishObserveRequest(const PendingRequest &request, DeviceManager::DeviceError error)
+{
+    bool success = error == DeviceManager::DeviceErrorNoError;
+
+    QHash<QUrl, ObservedResource>::iterator it = m_observedResources.find(request.url);
+    if (it == m_observedResources.end())
+        return;
+
+    ObservedResource &resource = it.value();
+    QList<QPair<Device *, ActionId> > waitingActions = resource.waitingActions;
+    resource.waitingActions.clear();
+
+    if (request.type == RequestTypeEnableNotifications) {
+        if (!success) {
+            resource.state = ObserveStateInactive;
+            for (int i = 0; i < waitingActions.count(); i++) {
+                emit actionExecutionFinished(waitingActions.at(i).second, error);
+            }
+        } else {
+            resource.state = ObserveStateActive;
+            m_notificationQueue->addResource(request.url);
+            for (int i = 0; i < waitingActions.count(); i++) {
+                Device *device = waitingActions.at(i).first;
+                if (!resource.devices.contains(device))
+                    resource.devices.append(device);
+
+                device->setStateValue(notificationsStateTypeId, true);
+                emit actionExecutionFinished(waitingActions.at(i).second, DeviceManager::DeviceErrorNoError);
+            }
+        }
+
+        // All subscribers left while the observation was being enabled. A timed out request
+        // stays with the CoAP socket and may still enable the observation, so disable it as well.
+        if (resource.devices.isEmpty()) {
+            bool observing = resource.state == ObserveStateActive || error == DeviceManager::DeviceErrorTimeout;
+            m_notificationQueue->removeResource(request.url);
+            if (observing && enqueueRequest(RequestTypeDisableNotifications, 0, request.url)) {
+                resource.state = ObserveStateDisabling;
+            } else {
+                m_observedResources.erase(it);
+            }
+        }
+        return;
+    }
+
+    // The observation has been disabled. The server forgets it anyway with the next notification we don't accept.
+    if (!success)
+        qCWarning(dcCoapClient) << "Could not disable notifications on resource" << request.url.toString();
+
+    // Somebody subscribed while the observation was being disabled, enable it again
+    if (!waitingActions.isEmpty() && enqueueRequest(RequestTypeEnableNotifications, 0, request.url)) {
+        resource.state = ObserveStateEnabling;
+        resource.waitingActions = waitingActions;
+        return;
+    }
+
+    for (int i = 0; i < waitingActions.count(); i++) {
+        emit actionExecutionFinished(waitingActions.at(i).second, DeviceManager::DeviceErrorHardwareNotAvailable);
+    }
+
+    m_observedResources.erase(it);
+}
+
+// This slot will be called whenever a client or the rule engine queued new requests
+void DevicePluginCoapClient::onSendTimeout()
+{
+    foreach (const QString &endpointName, m_endpoints.keys()) {
+        sendQueuedRequests(endpointName);
+    }
+}
+
+// This slot will be called once the multicast discovery window is over
+void DevicePluginCoapClient::onDiscoveryFinished(const QList<CoapMulticastDiscovery::Server> &servers)
+{
+    QList<DeviceDescriptor> deviceDescriptors;
+    foreach (const CoapMulticastDiscovery::Server &server, servers) {
+        QUrl url;
+        url.setScheme("coap");
+        url.setHost(server.address.toString());
+        url.setPort(server.port);
+
+        // List the resources of the server in the description
+        QByteArray resources;
+        LinkFormatParser parser(server.links);
+        LinkFormatParser::Link link;
+        while (parser.next(&link)) {
+            if (!resources.isEmpty())
+                resources.append(", ");
+
+            resources.append(link.path());
+        }
+
+        DeviceDescriptor descriptor(infoDeviceClassId, "CoAP server " + url.host(), QString::fromUtf8(resources));
+        ParamList params;
+        params.append(Param("url", url.toString()));
+        descriptor.setParams(params);
+        deviceDescriptors.append(descriptor);
+
+        // The devices created from the discovery don't need to ask for their resources again
+        QUrl discoveryUrl(url);
+        discoveryUrl.setPath("/.well-known/core");
+        m_discoveryCache->insert(discoveryUrl, server.links);
+    }
+
+    emit devicesDiscovered(infoDeviceClassId, deviceDescriptors);
+}
+
+// This slot will be called periodically to publish the metrics of the servers as device states
+void DevicePluginCoapClient::onMetricsTimeout()
+{
+    int interval = configValue("metrics interval").toInt();
+    if (interval <= 0 || myDevices().isEmpty()) {
+        m_metricsTimer->stop();
+        return;
+    }
+
+    m_metricsTimer->setInterval(interval * 1000);
+
+    qint64 now = m_clock.elapsed();
+    foreach (Device *device, myDevices()) {
+        QHash<QString, Endpoint>::iterator it = m_endpoints.find(endpointName(QUrl(InfoDeviceParams::fromDevice(device).url)));
+        if (it == m_endpoints.end())
+            continue;
+
+        Endpoint &endpoint = it.value();
+        device->setStateValue(roundTripTimeStateTypeId, endpoint.rttEstimator.roundTripTime());
+        device->setStateValue(retransmissionTimeoutStateTypeId, endpoint.rttEstimator.retransmissionTimeout(now));
+        device->setStateValue(requestsSentStateTypeId, endpoint.metrics.requestsSent());
+        device->setStateValue(slowExchangesStateTypeId, endpoint.metrics.slowExchanges());
+        device->setStateValue(timeoutsStateTypeId, endpoint.metrics.timeouts());
+        device->setStateValue(requestsInFlightStateTypeId, endpoint.requestsInFlight);
+        device->setStateValue(roundTripTimeP50StateTypeId, endpoint.metrics.roundTripTimePercentile(50));
+        device->setStateValue(roundTripTimeP99StateTypeId, endpoint.metrics.roundTripTimePercentile(99));
+        device->setStateValue(notificationsReceivedStateTypeId, endpoint.metrics.notificationsReceived());
+        device->setStateValue(notificationsDroppedStateTypeId, endpoint.metrics.notificationsDropped());
+
+        // The notification queue counts per observed resource
+        QUrl observeUrl(InfoDeviceParams::fromDevice(device).url);
+        observeUrl.setPath(observeUrl.path().append("/obs"));
+        device->setStateValue(notificationsReorderedStateTypeId, m_notificationQueue->reorderedCount(observeUrl));
+        device->setStateValue(notificationsCoalescedStateTypeId, m_notificationQueue->coalescedCount(observeUrl));
+    }
+}
+
+// This slot will be called once the CoAP socket wasn't used for a while
+void DevicePluginCoapClient::onIdleTimeout()
+{
+    if (!myDevices().isEmpty() || m_coap.isNull())
+        return;
+
+    qCDebug(dcCoapClient) << "Delete unused CoAP socket";
+    m_coap->deleteLater();
+}
+
+// This slot will be called periodically as long as there are pending requests
+void DevicePluginCoapClient::onTimeoutCheck()
+{
+    qint64 now = m_clock.elapsed();
+
+    // The deadlines are sorted, so only the expired requests will be visited
+    while (!m_requestDeadlines.isEmpty() && m_requestDeadlines.firstKey() <= now) {
+        CoapReply *reply = m_requestDeadlines.first();
+        PendingRequest request = m_pendingRequests.value(reply);
+        removePendingRequest(reply);
+
+        // The reply stays with the CoAP socket and will be deleted once it is finished
+        qCWarning(dcCoapClient) << "CoAP request timed out" << request.url.toString();
+        m_endpoints[request.endpoint].metrics.addTimeout();
+
+        if (m_trafficRecorder.isRecording())
+            m_trafficRecorder.recordTimeout(request.id);
+        finishPendingRequest(request, DeviceManager::DeviceErrorTimeout);
+    }
+
+    if (m_pendingRequests.isEmpty())
+        m_timeoutTimer->stop();
+}
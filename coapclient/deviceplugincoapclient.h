@@ -24,8 +24,22 @@
 #include "devicemanager.h"
 #include "plugin/deviceplugin.h"
 #include "coap/coap.h"
+#include "plugintables.h"
+
+#include "coapdiscoverycache.h"
+#include "coapmulticastdiscovery.h"
+#include "coapnotificationqueue.h"
+#include "coapmetrics.h"
+#include "coaprttestimator.h"
+#include "coaptrafficrecorder.h"
+#include "senmldecoder.h"
+#include "statesnapshot.h"
 
 #include <QHash>
+#include <QMultiMap>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QNetworkReply>
 
 class DevicePluginCoapClient : public DevicePlugin
@@ -39,6 +53,7 @@ public:
     explicit DevicePluginCoapClient();
 
     DeviceManager::HardwareResources requiredHardware() const override;
+    DeviceManager::DeviceError discoverDevices(const DeviceClassId &deviceClassId, const ParamList &params) override;
     DeviceManager::DeviceSetupStatus setupDevice(Device *device) override;
 
     // Will be called from the device manager once the user removes a configured device
@@ -47,20 +62,108 @@ public:
     DeviceManager::DeviceError executeAction(Device *device, const Action &action) override;
 
 private:
-    QPointer<Device> m_device;
+    // The action handlers, called by executeAction through the generated ActionDispatch table
+    friend class ActionDispatch<DevicePluginCoapClient>;
+
+    DeviceManager::DeviceError executeNotifications(Device *device, const Action &action);
+    DeviceManager::DeviceError executeUpload(Device *device, const Action &action);
+
     QPointer<Coap> m_coap;
 
-    // Replies from coap
-    QHash<CoapReply *, Device *> m_discoverReplies;
-    QHash<CoapReply *, Device *> m_notificationEnableReplies;
-    QHash<CoapReply *, Device *> m_notificationDisableReplies;
-    QList<CoapReply *> m_uploadReplies;
+    // Shuts down the shared CoAP socket once the last device is gone for a while
+    QTimer *m_idleTimer;
+
+    CoapDiscoveryCache *m_discoveryCache;
+    StateSnapshot *m_stateSnapshot;
+    CoapMulticastDiscovery *m_multicastDiscovery;
+    CoapTrafficRecorder m_trafficRecorder;
+
+    enum ObserveState {
+        ObserveStateInactive,
+        ObserveStateEnabling,
+        ObserveStateActive,
+        ObserveStateDisabling
+    };
+
+    // One upstream observation shared by all devices subscribed to the resource
+    struct ObservedResource {
+        ObservedResource() : state(ObserveStateInactive) { }
+        ObserveState state;
+        QString endpoint;
+        QList<Device *> devices;
+        QList<QPair<Device *, ActionId> > waitingActions;
+    };
+
+    // Observed resource URL -> devices receiving the notifications
+    QHash<QUrl, ObservedResource> m_observedResources;
+    CoapNotificationQueue *m_notificationQueue;
+
+    // The values are written to the traffic capture, append new types at the end
+    enum RequestType {
+        RequestTypeDiscover,
+        RequestTypeRevalidate,
+        RequestTypeEnableNotifications,
+        RequestTypeDisableNotifications,
+        RequestTypeUpload
+    };
+
+    struct PendingRequest {
+        RequestType type;
+        Device *device;
+        QString endpoint;
+        QUrl url;
+        QByteArray payload;
+        QList<ActionId> actionIds;
+        quint32 id;
+        qint64 sentTime;
+        qint64 deadline;
+    };
+
+    // Outgoing requests of one CoAP server (host and port)
+    struct Endpoint {
+        Endpoint() : requestsInFlight(0) { }
+        int requestsInFlight;
+        QQueue<PendingRequest> queue;
+        CoapRttEstimator rttEstimator;
+        CoapMetrics metrics;
+    };
+
+    QHash<QString, Endpoint> m_endpoints;
+    QTimer *m_sendTimer;
+    QTimer *m_metricsTimer;
+
+    // Replies from coap which are still waiting for a response
+    QHash<CoapReply *, PendingRequest> m_pendingRequests;
+
+    // Deadline -> reply, ordered so the timeout check only looks at expired requests
+    QMultiMap<qint64, CoapReply *> m_requestDeadlines;
+    quint32 m_requestCounter;
+    QElapsedTimer m_clock;
+    QTimer *m_timeoutTimer;
+
+    Coap *coap();
+    bool enqueueRequest(RequestType type, Device *device, const QUrl &url, const QByteArray &payload = QByteArray(), const ActionId &actionId = ActionId());
+    void sendQueuedRequests(const QString &endpointName);
+    void removePendingRequest(CoapReply *reply);
+    void updateRoundTripTime(const PendingRequest &request);
+    void processDiscoveryResponse(const PendingRequest &request, const QByteArray &payload);
+    void printLinks(const QByteArray &payload) const;
+    static DeviceManager::DeviceError replyError(CoapReply *reply);
+    void finishPendingRequest(const PendingRequest &request, DeviceManager::DeviceError error);
 
-    QHash< CoapReply *, ActionId> m_asyncActions;
+    DeviceManager::DeviceError subscribe(Device *device, const QUrl &url, const ActionId &actionId);
+    void unsubscribe(Device *device, const QUrl &url);
+    void finishObserveRequest(const PendingRequest &request, DeviceManager::DeviceError error);
 
 private slots:
+    void onIdleTimeout();
+    void onDiscoveryFinished(const QList<CoapMulticastDiscovery::Server> &servers);
+    void onSendTimeout();
+    void onTimeoutCheck();
+    void onMetricsTimeout();
     void onReplyFinished(CoapReply *reply);
     void onNotificationReceived(const CoapObserveResource &resource, const int &notificationNumber, const QByteArray &payload);
+    void onNotificationReady(const QUrl &url, const QByteArray &payload);
 
 };
 
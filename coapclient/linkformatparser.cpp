@@ -0,0 +1,216 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "linkformatparser.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Returns the first of the characters < > ; , " in [begin, end) or end
+static const char *findDelimiter(const char *begin, const char *end)
+{
+#ifdef __SSE2__
+    // Compare 16 characters at once
+    const __m128i lessThan = _mm_set1_epi8('<');
+    const __m128i greaterThan = _mm_set1_epi8('>');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+
+    while (end - begin >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lessThan), _mm_cmpeq_epi8(chunk, greaterThan)),
+                                       _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, semicolon), _mm_cmpeq_epi8(chunk, comma)),
+                                                    _mm_cmpeq_epi8(chunk, quote)));
+        int mask = _mm_movemask_epi8(matches);
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+
+        begin += 16;
+    }
+#endif
+
+    // Remaining characters (or all of them without SSE2)
+    for (; begin < end; ++begin) {
+        switch (*begin) {
+        case '<':
+        case '>':
+        case ';':
+        case ',':
+        case '"':
+            return begin;
+        default:
+            break;
+        }
+    }
+
+    return end;
+}
+
+LinkFormatParser::Link::Link() :
+    m_path(0),
+    m_pathLength(0),
+    m_attributes(0),
+    m_attributesLength(0)
+{
+}
+
+// Returns the URI reference of the link, without the angle brackets
+QByteArray LinkFormatParser::Link::path() const
+{
+    return QByteArray::fromRawData(m_path, m_pathLength);
+}
+
+// Returns all attributes of the link, e.g. ";rt=\"temperature\";obs"
+QByteArray LinkFormatParser::Link::attributes() const
+{
+    return QByteArray::fromRawData(m_attributes, m_attributesLength);
+}
+
+bool LinkFormatParser::Link::hasAttribute(const QByteArray &name) const
+{
+    QByteArray value;
+    return findAttribute(name, &value);
+}
+
+// Returns the value of the attribute without quotes, or an empty array
+QByteArray LinkFormatParser::Link::attribute(const QByteArray &name) const
+{
+    QByteArray value;
+    findAttribute(name, &value);
+    return value;
+}
+
+bool LinkFormatParser::Link::findAttribute(const QByteArray &name, QByteArray *value) const
+{
+    const char *position = m_attributes;
+    const char *end = m_attributes + m_attributesLength;
+
+    while (position < end) {
+        // Every attribute starts with ;
+        if (*position != ';')
+            return false;
+        position++;
+
+        // The attribute ends with the next ; outside of a quoted string
+        const char *attributeEnd = position;
+        bool quoted = false;
+        while (attributeEnd < end && (quoted || *attributeEnd != ';')) {
+            if (*attributeEnd == '"')
+                quoted = !quoted;
+            attributeEnd++;
+        }
+
+        const char *equals = static_cast<const char *>(memchr(position, '=', attributeEnd - position));
+        const char *nameEnd = equals ? equals : attributeEnd;
+
+        if (nameEnd - position == name.size() && memcmp(position, name.constData(), name.size()) == 0) {
+            if (!equals) {
+                *value = QByteArray();
+                return true;
+            }
+
+            const char *valueBegin = equals + 1;
+            const char *valueEnd = attributeEnd;
+            if (valueEnd - valueBegin >= 2 && *valueBegin == '"' && *(valueEnd - 1) == '"') {
+                valueBegin++;
+                valueEnd--;
+            }
+
+            *value = QByteArray::fromRawData(valueBegin, int(valueEnd - valueBegin));
+            return true;
+        }
+
+        position = attributeEnd;
+    }
+
+    return false;
+}
+
+LinkFormatParser::LinkFormatParser(const QByteArray &payload) :
+    m_data(payload.constData()),
+    m_end(payload.constData() + payload.size()),
+    m_position(payload.constData()),
+    m_error(false)
+{
+}
+
+// Reads the next link of the payload. Returns false once all links have been read or on a syntax error.
+bool LinkFormatParser::next(Link *link)
+{
+    if (m_error || m_position >= m_end)
+        return false;
+
+    // Every link starts with <
+    const char *delimiter = findDelimiter(m_position, m_end);
+    if (delimiter == m_end)
+        return false;
+
+    if (*delimiter != '<') {
+        m_error = true;
+        return false;
+    }
+
+    // The URI reference can't contain >
+    const char *pathBegin = delimiter + 1;
+    const char *pathEnd = static_cast<const char *>(memchr(pathBegin, '>', m_end - pathBegin));
+    if (!pathEnd) {
+        m_error = true;
+        return false;
+    }
+
+    link->m_path = pathBegin;
+    link->m_pathLength = int(pathEnd - pathBegin);
+
+    // The attributes end with the next , outside of a quoted string
+    const char *attributesBegin = pathEnd + 1;
+    const char *position = attributesBegin;
+    while (position < m_end) {
+        position = findDelimiter(position, m_end);
+        if (position == m_end || *position == ',')
+            break;
+
+        if (*position == '"') {
+            const char *quoteEnd = static_cast<const char *>(memchr(position + 1, '"', m_end - position - 1));
+            if (!quoteEnd) {
+                m_error = true;
+                return false;
+            }
+            position = quoteEnd;
+        }
+
+        position++;
+    }
+
+    link->m_attributes = attributesBegin;
+    link->m_attributesLength = int(position - attributesBegin);
+
+    // Skip the , between the links
+    m_position = position < m_end ? position + 1 : m_end;
+    return true;
+}
+
+bool LinkFormatParser::hasError() const
+{
+    return m_error;
+}
@@ -0,0 +1,65 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef LINKFORMATPARSER_H
+#define LINKFORMATPARSER_H
+
+#include <QByteArray>
+
+// Parser for the CoRE Link Format (RFC 6690). The links are views into the
+// payload, which has to stay alive while they are in use. Nothing will be
+// allocated per link and the attributes are only parsed on request.
+class LinkFormatParser
+{
+public:
+    class Link
+    {
+    public:
+        Link();
+
+        QByteArray path() const;
+        QByteArray attributes() const;
+
+        bool hasAttribute(const QByteArray &name) const;
+        QByteArray attribute(const QByteArray &name) const;
+
+    private:
+        friend class LinkFormatParser;
+        const char *m_path;
+        int m_pathLength;
+        const char *m_attributes;
+        int m_attributesLength;
+
+        bool findAttribute(const QByteArray &name, QByteArray *value) const;
+    };
+
+    explicit LinkFormatParser(const QByteArray &payload);
+
+    bool next(Link *link);
+    bool hasError() const;
+
+private:
+    const char *m_data;
+    const char *m_end;
+    const char *m_position;
+    bool m_error;
+};
+
+#endif // LINKFORMATPARSER_H
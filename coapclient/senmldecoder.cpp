@@ -0,0 +1,426 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "senmldecoder.h"
+
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QtNumeric>
+
+#include <cmath>
+#include <cstring>
+
+// SenML labels in the CBOR representation (RFC 8428 section 6)
+enum SenmlCborLabel {
+    SenmlCborLabelBaseValue = -5,
+    SenmlCborLabelBaseName = -2,
+    SenmlCborLabelName = 0,
+    SenmlCborLabelValue = 2,
+    SenmlCborLabelStringValue = 3,
+    SenmlCborLabelBoolValue = 4
+};
+
+// Minimal CBOR reader (RFC 7049) for the data items used by SenML. Strings are
+// returned as views into the payload, nothing will be copied.
+class CborReader
+{
+public:
+    enum MajorType {
+        MajorTypeUnsigned = 0,
+        MajorTypeNegative = 1,
+        MajorTypeBytes = 2,
+        MajorTypeText = 3,
+        MajorTypeArray = 4,
+        MajorTypeMap = 5,
+        MajorTypeTag = 6,
+        MajorTypeSimple = 7
+    };
+
+    // Length of arrays and maps with indefinite length
+    static const quint64 indefinite = ~quint64(0);
+
+    CborReader(const QByteArray &data) :
+        m_data(reinterpret_cast<const uchar *>(data.constData())),
+        m_size(data.size()),
+        m_position(0),
+        m_error(false)
+    {
+    }
+
+    bool hasError() const { return m_error; }
+    bool atEnd() const { return m_position >= m_size; }
+
+    // Returns true and skips the break code if the next item ends an indefinite array or map
+    bool atBreak()
+    {
+        if (m_position < m_size && m_data[m_position] == 0xff) {
+            m_position++;
+            return true;
+        }
+        return false;
+    }
+
+    // Reads the header of the next data item
+    bool readHeader(MajorType *type, quint64 *argument, uchar *additional)
+    {
+        if (m_position >= m_size)
+            return fail();
+
+        uchar initial = m_data[m_position++];
+        *type = MajorType(initial >> 5);
+        *additional = initial & 0x1f;
+
+        if (*additional < 24) {
+            *argument = *additional;
+            return true;
+        }
+
+        if (*additional == 31) {
+            *argument = indefinite;
+            return true;
+        }
+
+        int length = 0;
+        switch (*additional) {
+        case 24: length = 1; break;
+        case 25: length = 2; break;
+        case 26: length = 4; break;
+        case 27: length = 8; break;
+        default: return fail();
+        }
+
+        if (m_position + length > m_size)
+            return fail();
+
+        *argument = 0;
+        for (int i = 0; i < length; i++) {
+            *argument = (*argument << 8) | m_data[m_position++];
+        }
+        return true;
+    }
+
+    // Returns a view on the next string of the given length
+    bool readString(quint64 length, QByteArray *string)
+    {
+        if (length == indefinite || m_position + length > quint64(m_size))
+            return fail();
+
+        *string = QByteArray::fromRawData(reinterpret_cast<const char *>(m_data + m_position), int(length));
+        m_position += int(length);
+        return true;
+    }
+
+    // Reads the next data item as a SenML value
+    bool readValue(QVariant *value)
+    {
+        MajorType type;
+        quint64 argument;
+        uchar additional;
+        if (!readHeader(&type, &argument, &additional))
+            return false;
+
+        switch (type) {
+        case MajorTypeUnsigned:
+            *value = double(argument);
+            return true;
+        case MajorTypeNegative:
+            *value = -1.0 - double(argument);
+            return true;
+        case MajorTypeBytes:
+        case MajorTypeText: {
+            QByteArray string;
+            if (!readString(argument, &string))
+                return false;
+            *value = type == MajorTypeText ? QVariant(QString::fromUtf8(string)) : QVariant(QByteArray(string.constData(), string.size()));
+            return true;
+        }
+        case MajorTypeSimple:
+            return readSimple(argument, additional, value);
+        default:
+            // Nested arrays, maps and tags are no SenML values, skip them
+            *value = QVariant();
+            return skipContent(type, argument);
+        }
+    }
+
+    // Skips the content of a data item whose header has already been read
+    bool skipContent(MajorType type, quint64 argument)
+    {
+        switch (type) {
+        case MajorTypeBytes:
+        case MajorTypeText: {
+            QByteArray string;
+            return readString(argument, &string);
+        }
+        case MajorTypeArray:
+        case MajorTypeMap: {
+            quint64 items = type == MajorTypeMap && argument != indefinite ? argument * 2 : argument;
+            for (quint64 i = 0; items == indefinite || i < items; i++) {
+                if (items == indefinite && atBreak())
+                    return true;
+
+                if (!skip())
+                    return false;
+            }
+            return true;
+        }
+        case MajorTypeTag:
+            return skip();
+        default:
+            return true;
+        }
+    }
+
+    bool skip()
+    {
+        MajorType type;
+        quint64 argument;
+        uchar additional;
+        if (!readHeader(&type, &argument, &additional))
+            return false;
+
+        return skipContent(type, argument);
+    }
+
+private:
+    const uchar *m_data;
+    int m_size;
+    int m_position;
+    bool m_error;
+
+    bool fail()
+    {
+        m_error = true;
+        return false;
+    }
+
+    bool readSimple(quint64 argument, uchar additional, QVariant *value)
+    {
+        switch (additional) {
+        case 20:
+            *value = false;
+            return true;
+        case 21:
+            *value = true;
+            return true;
+        case 25:
+            *value = halfToDouble(quint16(argument));
+            return true;
+        case 26: {
+            quint32 bits = quint32(argument);
+            float number;
+            memcpy(&number, &bits, sizeof(number));
+            *value = double(number);
+            return true;
+        }
+        case 27: {
+            double number;
+            memcpy(&number, &argument, sizeof(number));
+            *value = number;
+            return true;
+        }
+        default:
+            *value = QVariant();
+            return true;
+        }
+    }
+
+    static double halfToDouble(quint16 half)
+    {
+        int exponent = (half >> 10) & 0x1f;
+        int mantissa = half & 0x3ff;
+        double value;
+        if (exponent == 0) {
+            value = std::ldexp(double(mantissa), -24);
+        } else if (exponent != 31) {
+            value = std::ldexp(double(mantissa + 1024), exponent - 25);
+        } else {
+            value = mantissa == 0 ? qInf() : qQNaN();
+        }
+        return half & 0x8000 ? -value : value;
+    }
+};
+
+// Guesses the representation from the first byte, notifications don't carry their Content-Format
+SenmlDecoder::Format SenmlDecoder::detectFormat(const QByteArray &payload)
+{
+    if (payload.isEmpty())
+        return FormatUnknown;
+
+    uchar first = payload.at(0);
+
+    // JSON array of records
+    if (first == '[')
+        return FormatJson;
+
+    // CBOR array of records with definite or indefinite length
+    if ((first >= 0x80 && first <= 0x9b) || first == 0x9f)
+        return FormatCbor;
+
+    return FormatUnknown;
+}
+
+// Decodes the records of the payload. Each record gets the base name in effect for it.
+bool SenmlDecoder::decode(const QByteArray &payload, Format format, QList<Record> *records)
+{
+    switch (format) {
+    case FormatJson:
+        return decodeJson(payload, records);
+    case FormatCbor:
+        return decodeCbor(payload, records);
+    default:
+        return false;
+    }
+}
+
+bool SenmlDecoder::decodeJson(const QByteArray &payload, QList<Record> *records)
+{
+    QJsonParseError error;
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(payload, &error);
+    if (error.error != QJsonParseError::NoError || !jsonDoc.isArray())
+        return false;
+
+    QByteArray baseName;
+    double baseValue = 0;
+
+    foreach (const QJsonValue &value, jsonDoc.array()) {
+        QJsonObject object = value.toObject();
+
+        if (object.contains("bn"))
+            baseName = object.value("bn").toString().toUtf8();
+
+        if (object.contains("bv"))
+            baseValue = object.value("bv").toDouble();
+
+        Record record;
+        record.baseName = baseName;
+        record.name = object.value("n").toString().toUtf8();
+
+        if (object.contains("v")) {
+            record.value = baseValue + object.value("v").toDouble();
+        } else if (object.contains("vs")) {
+            record.value = object.value("vs").toString();
+        } else if (object.contains("vb")) {
+            record.value = object.value("vb").toBool();
+        } else {
+            continue;
+        }
+
+        records->append(record);
+    }
+
+    return true;
+}
+
+bool SenmlDecoder::decodeCbor(const QByteArray &payload, QList<Record> *records)
+{
+    CborReader reader(payload);
+
+    CborReader::MajorType type;
+    quint64 recordCount;
+    uchar additional;
+    if (!reader.readHeader(&type, &recordCount, &additional) || type != CborReader::MajorTypeArray)
+        return false;
+
+    QByteArray baseName;
+    double baseValue = 0;
+
+    for (quint64 i = 0; recordCount == CborReader::indefinite || i < recordCount; i++) {
+        if (recordCount == CborReader::indefinite && reader.atBreak())
+            break;
+
+        quint64 pairCount;
+        if (!reader.readHeader(&type, &pairCount, &additional))
+            return false;
+
+        if (type != CborReader::MajorTypeMap) {
+            if (!reader.skipContent(type, pairCount))
+                return false;
+            continue;
+        }
+
+        QByteArray name;
+        QVariant value;
+
+        for (quint64 j = 0; pairCount == CborReader::indefinite || j < pairCount; j++) {
+            if (pairCount == CborReader::indefinite && reader.atBreak())
+                break;
+
+            // Labels are small integers, negative ones are the base fields
+            quint64 labelArgument;
+            if (!reader.readHeader(&type, &labelArgument, &additional))
+                return false;
+
+            if (type != CborReader::MajorTypeUnsigned && type != CborReader::MajorTypeNegative) {
+                if (!reader.skipContent(type, labelArgument) || !reader.skip())
+                    return false;
+                continue;
+            }
+
+            int label = type == CborReader::MajorTypeUnsigned ? int(labelArgument) : -1 - int(labelArgument);
+
+            // Names stay views into the payload, they are only compared with the state fields
+            if (label == SenmlCborLabelBaseName || label == SenmlCborLabelName) {
+                quint64 length;
+                if (!reader.readHeader(&type, &length, &additional))
+                    return false;
+
+                if (type != CborReader::MajorTypeText) {
+                    if (!reader.skipContent(type, length))
+                        return false;
+                    continue;
+                }
+
+                if (!reader.readString(length, label == SenmlCborLabelBaseName ? &baseName : &name))
+                    return false;
+                continue;
+            }
+
+            QVariant item;
+            if (!reader.readValue(&item))
+                return false;
+
+            switch (label) {
+            case SenmlCborLabelBaseValue:
+                baseValue = item.toDouble();
+                break;
+            case SenmlCborLabelValue:
+            case SenmlCborLabelStringValue:
+            case SenmlCborLabelBoolValue:
+                value = item;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (!value.isValid())
+            continue;
+
+        Record record;
+        record.baseName = baseName;
+        record.name = name;
+        record.value = value.type() == QVariant::Double ? QVariant(baseValue + value.toDouble()) : value;
+        records->append(record);
+    }
+
+    return !reader.hasError();
+}
@@ -0,0 +1,55 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef SENMLDECODER_H
+#define SENMLDECODER_H
+
+#include <QByteArray>
+#include <QVariant>
+#include <QList>
+
+// Decodes SenML records (RFC 8428) in JSON or CBOR representation
+class SenmlDecoder
+{
+public:
+    enum Format {
+        FormatUnknown,
+        FormatJson,
+        FormatCbor
+    };
+
+    // The name is the "n" field of the record, the base name is kept apart because it
+    // usually identifies the device (e.g. "urn:dev:mac:...:") and not the measurement.
+    // Names decoded from CBOR are views into the payload, which has to outlive the records.
+    struct Record {
+        QByteArray baseName;
+        QByteArray name;
+        QVariant value;
+    };
+
+    static Format detectFormat(const QByteArray &payload);
+    static bool decode(const QByteArray &payload, Format format, QList<Record> *records);
+
+private:
+    static bool decodeJson(const QByteArray &payload, QList<Record> *records);
+    static bool decodeCbor(const QByteArray &payload, QList<Record> *records);
+};
+
+#endif // SENMLDECODER_H
@@ -0,0 +1,41 @@
+# Shared harness of the plugin benchmarks. A benchmark project sets JSONFILES to the
+# JSON file of its plugin and includes this file.
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+
+QT += network
+
+QMAKE_CXXFLAGS += -Werror -std=c++11
+QMAKE_LFLAGS += -std=c++11
+
+INCLUDEPATH += /usr/include/guh/ $$PWD $$PWD/..
+LIBS += -lguh
+
+# The ids of the plugin, the benchmarks use them to create devices and actions
+infofile.output = plugininfo.h
+infofile.commands = /usr/bin/guh-generateplugininfo ${QMAKE_FILE_NAME} ${QMAKE_FILE_OUT}
+infofile.depends = /usr/bin/guh-generateplugininfo
+infofile.CONFIG = no_link
+infofile.input = JSONFILES
+
+QMAKE_EXTRA_COMPILERS += infofile
+
+# Lookup tables generated from the plugin JSON file (see tools/generateplugintables.py)
+plugintables.output = plugintables.h
+plugintables.commands = $$PWD/../../tools/generateplugintables.py ${QMAKE_FILE_NAME} ${QMAKE_FILE_OUT}
+plugintables.depends = $$PWD/../../tools/generateplugintables.py
+plugintables.CONFIG = no_link
+plugintables.input = JSONFILES
+
+QMAKE_EXTRA_COMPILERS += plugintables
+
+SOURCES += \
+    $$PWD/allocationcounter.cpp \
+    $$PWD/benchmarkresult.cpp \
+    $$PWD/pluginbenchmarkhost.cpp \
+
+HEADERS += \
+    $$PWD/allocationcounter.h \
+    $$PWD/benchmarkresult.h \
+    $$PWD/pluginbenchmarkhost.h \
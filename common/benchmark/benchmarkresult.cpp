@@ -0,0 +1,151 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "benchmarkresult.h"
+
+#include <algorithm>
+
+BenchmarkResult::BenchmarkResult(const QString &name) :
+    m_name(name),
+    m_failures(0),
+    m_duration(0),
+    m_allocations(0),
+    m_allocatedBytes(0)
+{
+}
+
+// Starts the wall clock and the allocation count of the operation
+void BenchmarkResult::start()
+{
+    m_samples.clear();
+    m_failures = 0;
+    m_allocations = AllocationCounter::allocations();
+    m_allocatedBytes = AllocationCounter::allocatedBytes();
+    m_clock.start();
+}
+
+void BenchmarkResult::addSample(qint64 nanoSeconds)
+{
+    m_samples.append(nanoSeconds);
+}
+
+void BenchmarkResult::addFailure()
+{
+    m_failures++;
+}
+
+void BenchmarkResult::finish()
+{
+    m_duration = m_clock.nsecsElapsed();
+    m_allocations = AllocationCounter::allocations() - m_allocations;
+    m_allocatedBytes = AllocationCounter::allocatedBytes() - m_allocatedBytes;
+}
+
+QString BenchmarkResult::name() const
+{
+    return m_name;
+}
+
+// Returns the number of successful operations
+int BenchmarkResult::count() const
+{
+    return m_samples.count();
+}
+
+int BenchmarkResult::failures() const
+{
+    return m_failures;
+}
+
+// Returns the given percentile of the operation durations in nanoseconds
+qint64 BenchmarkResult::percentile(int percentile) const
+{
+    if (m_samples.isEmpty())
+        return 0;
+
+    QVector<qint64> samples = m_samples;
+    int rank = qMax(0, (samples.count() * percentile + 99) / 100 - 1);
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples.at(rank);
+}
+
+double BenchmarkResult::operationsPerSecond() const
+{
+    if (m_duration <= 0)
+        return 0;
+
+    return m_samples.count() * 1e9 / m_duration;
+}
+
+// Failed operations allocate as well, so they count here
+double BenchmarkResult::allocationsPerOperation() const
+{
+    int operations = m_samples.count() + m_failures;
+    if (operations == 0)
+        return 0;
+
+    return double(m_allocations) / operations;
+}
+
+double BenchmarkResult::allocatedBytesPerOperation() const
+{
+    int operations = m_samples.count() + m_failures;
+    if (operations == 0)
+        return 0;
+
+    return double(m_allocatedBytes) / operations;
+}
+
+// Returns one line of the report, see header()
+QString BenchmarkResult::toString() const
+{
+    return QString("%1 %2 %3 %4 %5 %6 %7 %8")
+            .arg(m_name, -32)
+            .arg(m_samples.count(), 8)
+            .arg(m_failures, 6)
+            .arg(percentile(50) / 1e6, 10, 'f', 3)
+            .arg(percentile(99) / 1e6, 10, 'f', 3)
+            .arg(operationsPerSecond(), 12, 'f', 1)
+            .arg(allocationsPerOperation(), 10, 'f', 1)
+            .arg(allocatedBytesPerOperation(), 10, 'f', 0);
+}
+
+QString BenchmarkResult::header()
+{
+    return QString("%1 %2 %3 %4 %5 %6 %7 %8")
+            .arg("operation", -32)
+            .arg("count", 8)
+            .arg("failed", 6)
+            .arg("p50 [ms]", 10)
+            .arg("p99 [ms]", 10)
+            .arg("ops/s", 12)
+            .arg("allocs/op", 10)
+            .arg("bytes/op", 10);
+}
+
+// Returns a monotonic time in nanoseconds, shared by everything in the benchmark process
+qint64 BenchmarkResult::timestamp()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid())
+        clock.start();
+
+    return clock.nsecsElapsed();
+}
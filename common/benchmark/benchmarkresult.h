@@ -0,0 +1,87 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef BENCHMARKRESULT_H
+#define BENCHMARKRESULT_H
+
+#include "allocationcounter.h"
+
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+
+// Latencies, throughput and allocations of one benchmarked operation.
+//
+// The samples are the durations of the single operations, the throughput is
+// the number of operations over the time between start() and finish(), so
+// concurrent operations count once.
+class BenchmarkResult
+{
+public:
+    explicit BenchmarkResult(const QString &name = QString());
+
+    void start();
+    void addSample(qint64 nanoSeconds);
+    void addFailure();
+    void finish();
+
+    QString name() const;
+    int count() const;
+    int failures() const;
+
+    qint64 percentile(int percentile) const;
+    double operationsPerSecond() const;
+    double allocationsPerOperation() const;
+    double allocatedBytesPerOperation() const;
+
+    QString toString() const;
+
+    static QString header();
+    static qint64 timestamp();
+
+    // Calls function(i) for i in [0, iterations) and measures each call
+    template <typename Function>
+    static BenchmarkResult measure(const QString &name, int iterations, Function function)
+    {
+        BenchmarkResult result(name);
+        result.start();
+        for (int i = 0; i < iterations; i++) {
+            qint64 begin = timestamp();
+            if (function(i)) {
+                result.addSample(timestamp() - begin);
+            } else {
+                result.addFailure();
+            }
+        }
+        result.finish();
+        return result;
+    }
+
+private:
+    QString m_name;
+    QVector<qint64> m_samples;
+    int m_failures;
+    QElapsedTimer m_clock;
+    qint64 m_duration;
+    quint64 m_allocations;
+    quint64 m_allocatedBytes;
+};
+
+#endif // BENCHMARKRESULT_H
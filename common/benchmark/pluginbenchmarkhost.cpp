@@ -0,0 +1,238 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "pluginbenchmarkhost.h"
+#include "plugin/deviceplugin.h"
+
+#include <QCoreApplication>
+#include <QLoggingCategory>
+#include <QEventLoop>
+#include <QTimer>
+#include <QHash>
+#include <QDir>
+
+// The plugin of the benchmark is the one providing the given device class
+PluginBenchmarkHost::PluginBenchmarkHost(const DeviceClassId &deviceClassId, QObject *parent) :
+    QObject(parent),
+    m_deviceClassId(deviceClassId),
+    m_deviceManager(0)
+{
+    // GuhSettings keeps the settings below the home directory and the organization name,
+    // don't touch the ones of a real installation
+    qputenv("HOME", m_settingsDir.path().toLocal8Bit());
+    QCoreApplication::setOrganizationName("guh-benchmark");
+
+    // The debug output of the plugins would dominate the measurements
+    QLoggingCategory::setFilterRules("*.debug=false\n*.warning=false");
+}
+
+// Loads the plugins with the plugin of the benchmark from the given directory
+bool PluginBenchmarkHost::load(const QString &pluginPath, int timeout)
+{
+    // Search the build directory of the plugin before the installed plugins
+    QString path = QDir(pluginPath).absolutePath();
+    qputenv("GUH_PLUGINS_PATH", path.toLocal8Bit());
+    QCoreApplication::addLibraryPath(path);
+
+    m_deviceManager = new DeviceManager(this);
+
+    QEventLoop loop;
+    connect(m_deviceManager, &DeviceManager::loaded, &loop, &QEventLoop::quit);
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+    loop.exec();
+
+    m_pluginId = m_deviceManager->findDeviceClass(m_deviceClassId).pluginId();
+    if (!plugin()) {
+        qWarning() << "Could not load the plugin of" << m_deviceClassId.toString() << "from" << path;
+        return false;
+    }
+
+    return true;
+}
+
+// Changes one value of the plugin configuration, the others keep their current value
+bool PluginBenchmarkHost::setPluginConfig(const QString &name, const QVariant &value)
+{
+    ParamList configuration = plugin()->configuration();
+    for (int i = 0; i < configuration.count(); i++) {
+        if (configuration.at(i).name() == name)
+            configuration[i].setValue(value);
+    }
+
+    DeviceManager::DeviceError error = m_deviceManager->setPluginConfig(m_pluginId, configuration);
+    if (error != DeviceManager::DeviceErrorNoError) {
+        qWarning() << "Could not set" << name << "to" << value << error;
+        return false;
+    }
+
+    return true;
+}
+
+DeviceManager *PluginBenchmarkHost::deviceManager() const
+{
+    return m_deviceManager;
+}
+
+DevicePlugin *PluginBenchmarkHost::plugin() const
+{
+    if (!m_deviceManager)
+        return 0;
+
+    return m_deviceManager->plugin(m_pluginId);
+}
+
+// Returns the devices set up successfully by addDevices()
+QList<Device *> PluginBenchmarkHost::devices() const
+{
+    return m_devices;
+}
+
+BenchmarkResult PluginBenchmarkHost::addDevices(const QString &name, int count, int concurrency, const DeviceClassId &deviceClassId,
+                                                const std::function<ParamList (int)> &createParams, int timeout)
+{
+    BenchmarkResult result(name);
+    QHash<DeviceId, qint64> running;
+    int started = 0;
+    QEventLoop loop;
+
+    std::function<void ()> startSetups = [&]() {
+        while (started < count && running.count() < concurrency) {
+            DeviceId deviceId = DeviceId::createDeviceId();
+            qint64 begin = BenchmarkResult::timestamp();
+            running.insert(deviceId, begin);
+
+            DeviceManager::DeviceError error = m_deviceManager->addConfiguredDevice(deviceClassId, QString("benchmark %1").arg(started), createParams(started), deviceId);
+            started++;
+
+            if (error == DeviceManager::DeviceErrorAsync)
+                continue;
+
+            running.remove(deviceId);
+            if (error == DeviceManager::DeviceErrorNoError) {
+                result.addSample(BenchmarkResult::timestamp() - begin);
+                m_devices.append(m_deviceManager->findConfiguredDevice(deviceId));
+            } else {
+                result.addFailure();
+            }
+        }
+
+        if (started == count && running.isEmpty())
+            loop.quit();
+    };
+
+    connect(m_deviceManager, &DeviceManager::deviceSetupFinished, &loop, [&](Device *device, DeviceManager::DeviceError error) {
+        if (!running.contains(device->id()))
+            return;
+
+        qint64 begin = running.take(device->id());
+        if (error == DeviceManager::DeviceErrorNoError) {
+            result.addSample(BenchmarkResult::timestamp() - begin);
+            m_devices.append(device);
+        } else {
+            result.addFailure();
+        }
+
+        startSetups();
+    });
+
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+
+    result.start();
+    startSetups();
+    if (started < count || !running.isEmpty())
+        loop.exec();
+
+    // Setups still running after the timeout failed
+    int unfinished = running.count() + count - started;
+    for (int i = 0; i < unfinished; i++)
+        result.addFailure();
+
+    result.finish();
+    return result;
+}
+
+BenchmarkResult PluginBenchmarkHost::executeActions(const QString &name, int count, int concurrency,
+                                                    const std::function<Action (int)> &createAction, int timeout)
+{
+    BenchmarkResult result(name);
+    QHash<ActionId, qint64> running;
+    int started = 0;
+    QEventLoop loop;
+
+    std::function<void ()> startActions = [&]() {
+        while (started < count && running.count() < concurrency) {
+            Action action = createAction(started);
+            qint64 begin = BenchmarkResult::timestamp();
+            running.insert(action.id(), begin);
+
+            DeviceManager::DeviceError error = m_deviceManager->executeAction(action);
+            started++;
+
+            if (error == DeviceManager::DeviceErrorAsync)
+                continue;
+
+            running.remove(action.id());
+            if (error == DeviceManager::DeviceErrorNoError) {
+                result.addSample(BenchmarkResult::timestamp() - begin);
+            } else {
+                result.addFailure();
+            }
+        }
+
+        if (started == count && running.isEmpty())
+            loop.quit();
+    };
+
+    connect(m_deviceManager, &DeviceManager::actionExecutionFinished, &loop, [&](const ActionId &actionId, DeviceManager::DeviceError error) {
+        if (!running.contains(actionId))
+            return;
+
+        qint64 begin = running.take(actionId);
+        if (error == DeviceManager::DeviceErrorNoError) {
+            result.addSample(BenchmarkResult::timestamp() - begin);
+        } else {
+            result.addFailure();
+        }
+
+        startActions();
+    });
+
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+
+    result.start();
+    startActions();
+    if (started < count || !running.isEmpty())
+        loop.exec();
+
+    int unfinished = running.count() + count - started;
+    for (int i = 0; i < unfinished; i++)
+        result.addFailure();
+
+    result.finish();
+    return result;
+}
+
+// Runs the event loop for the given time
+void PluginBenchmarkHost::wait(int milliSeconds)
+{
+    QEventLoop loop;
+    QTimer::singleShot(milliSeconds, &loop, SLOT(quit()));
+    loop.exec();
+}
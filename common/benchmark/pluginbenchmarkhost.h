@@ -0,0 +1,70 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef PLUGINBENCHMARKHOST_H
+#define PLUGINBENCHMARKHOST_H
+
+#include "devicemanager.h"
+#include "plugin/device.h"
+#include "types/action.h"
+#include "types/param.h"
+
+#include "benchmarkresult.h"
+
+#include <QObject>
+#include <QTemporaryDir>
+
+#include <functional>
+
+// Runs a device plugin in a DeviceManager, the same way guhd does, and measures
+// the device setups and action executions. The settings of the device manager
+// and the plugins are kept in a temporary directory.
+class PluginBenchmarkHost : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PluginBenchmarkHost(const DeviceClassId &deviceClassId, QObject *parent = 0);
+
+    bool load(const QString &pluginPath, int timeout = 10000);
+    bool setPluginConfig(const QString &name, const QVariant &value);
+
+    DeviceManager *deviceManager() const;
+    DevicePlugin *plugin() const;
+    QList<Device *> devices() const;
+
+    // Sets up count devices, at most concurrency of them at the same time
+    BenchmarkResult addDevices(const QString &name, int count, int concurrency, const DeviceClassId &deviceClassId,
+                               const std::function<ParamList (int index)> &createParams, int timeout);
+
+    // Executes count actions, at most concurrency of them at the same time
+    BenchmarkResult executeActions(const QString &name, int count, int concurrency,
+                                   const std::function<Action (int index)> &createAction, int timeout);
+
+    static void wait(int milliSeconds);
+
+private:
+    DeviceClassId m_deviceClassId;
+    PluginId m_pluginId;
+    QTemporaryDir m_settingsDir;
+    DeviceManager *m_deviceManager;
+    QList<Device *> m_devices;
+};
+
+#endif // PLUGINBENCHMARKHOST_H
@@ -0,0 +1,363 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "jsonstatemapper.h"
+
+// Single pass reader for the top level object of a JSON document
+class JsonScanner
+{
+public:
+    JsonScanner(const QByteArray &data) :
+        m_data(data.constData()),
+        m_end(data.constData() + data.size()),
+        m_error(0)
+    {
+    }
+
+    const char *error() const { return m_error; }
+
+    bool atEnd()
+    {
+        skipWhitespace();
+        return m_data == m_end;
+    }
+
+    bool expect(char c)
+    {
+        skipWhitespace();
+        if (m_data == m_end || *m_data != c)
+            return fail("unexpected character");
+
+        m_data++;
+        return true;
+    }
+
+    bool peek(char c)
+    {
+        skipWhitespace();
+        return m_data != m_end && *m_data == c;
+    }
+
+    // Returns a view into the data as long as the key contains no escape sequences
+    bool readKey(QByteArray *key)
+    {
+        skipWhitespace();
+        const char *begin = m_data + 1;
+        if (!skipString())
+            return false;
+
+        QByteArray raw = QByteArray::fromRawData(begin, m_data - begin - 1);
+        if (raw.contains('\\')) {
+            QString decoded;
+            if (!decodeString(raw, &decoded))
+                return false;
+
+            *key = decoded.toUtf8();
+        } else {
+            *key = raw;
+        }
+        return true;
+    }
+
+    // Decodes strings, numbers and booleans. Null, objects and arrays result in an invalid value.
+    bool readValue(QVariant *value)
+    {
+        skipWhitespace();
+        if (m_data == m_end)
+            return fail("unexpected end of data");
+
+        const char *begin = m_data;
+        switch (*m_data) {
+        case '"': {
+            if (!skipString())
+                return false;
+
+            QString string;
+            if (!decodeString(QByteArray::fromRawData(begin + 1, m_data - begin - 2), &string))
+                return false;
+
+            *value = string;
+            return true;
+        }
+        case 't':
+            *value = true;
+            return skipLiteral("true");
+        case 'f':
+            *value = false;
+            return skipLiteral("false");
+        case '{':
+        case '[':
+        case 'n':
+            *value = QVariant();
+            return skipValue();
+        default:
+            if (!skipNumber())
+                return false;
+
+            bool ok = false;
+            double number = QByteArray(begin, m_data - begin).toDouble(&ok);
+            if (!ok)
+                return fail("invalid number");
+
+            *value = number;
+            return true;
+        }
+    }
+
+    bool skipValue()
+    {
+        skipWhitespace();
+        if (m_data == m_end)
+            return fail("unexpected end of data");
+
+        switch (*m_data) {
+        case '"':
+            return skipString();
+        case 't':
+            return skipLiteral("true");
+        case 'f':
+            return skipLiteral("false");
+        case 'n':
+            return skipLiteral("null");
+        case '{':
+        case '[':
+            return skipContainer();
+        default:
+            return skipNumber();
+        }
+    }
+
+private:
+    const char *m_data;
+    const char *m_end;
+    const char *m_error;
+
+    bool fail(const char *error)
+    {
+        if (!m_error)
+            m_error = error;
+
+        return false;
+    }
+
+    void skipWhitespace()
+    {
+        while (m_data != m_end && (*m_data == ' ' || *m_data == '\t' || *m_data == '\n' || *m_data == '\r'))
+            m_data++;
+    }
+
+    bool skipString()
+    {
+        if (m_data == m_end || *m_data != '"')
+            return fail("string expected");
+
+        for (m_data++; m_data != m_end; m_data++) {
+            if (*m_data == '\\') {
+                if (++m_data == m_end)
+                    break;
+            } else if (*m_data == '"') {
+                m_data++;
+                return true;
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool skipLiteral(const char *literal)
+    {
+        for (; *literal; literal++, m_data++) {
+            if (m_data == m_end || *m_data != *literal)
+                return fail("invalid literal");
+        }
+        return true;
+    }
+
+    bool skipNumber()
+    {
+        const char *begin = m_data;
+        while (m_data != m_end && ((*m_data >= '0' && *m_data <= '9') || *m_data == '-' || *m_data == '+' || *m_data == '.' || *m_data == 'e' || *m_data == 'E'))
+            m_data++;
+
+        if (m_data == begin)
+            return fail("unexpected character");
+
+        return true;
+    }
+
+    // Objects and arrays are skipped by matching the brackets, strings are skipped as a whole
+    bool skipContainer()
+    {
+        QByteArray brackets;
+        while (m_data != m_end) {
+            switch (*m_data) {
+            case '"':
+                if (!skipString())
+                    return false;
+                continue;
+            case '{':
+                brackets.append('}');
+                break;
+            case '[':
+                brackets.append(']');
+                break;
+            case '}':
+            case ']':
+                if (brackets.isEmpty() || brackets.at(brackets.size() - 1) != *m_data)
+                    return fail("mismatched bracket");
+
+                brackets.chop(1);
+                if (brackets.isEmpty()) {
+                    m_data++;
+                    return true;
+                }
+                break;
+            default:
+                break;
+            }
+            m_data++;
+        }
+        return fail("unterminated object or array");
+    }
+
+    static int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    bool decodeString(const QByteArray &raw, QString *string)
+    {
+        if (!raw.contains('\\')) {
+            *string = QString::fromUtf8(raw);
+            return true;
+        }
+
+        QByteArray utf8;
+        utf8.reserve(raw.size());
+        for (int i = 0; i < raw.size(); i++) {
+            char c = raw.at(i);
+            if (c != '\\') {
+                utf8.append(c);
+                continue;
+            }
+
+            if (++i == raw.size())
+                return fail("invalid escape sequence");
+
+            switch (raw.at(i)) {
+            case '"': utf8.append('"'); break;
+            case '\\': utf8.append('\\'); break;
+            case '/': utf8.append('/'); break;
+            case 'b': utf8.append('\b'); break;
+            case 'f': utf8.append('\f'); break;
+            case 'n': utf8.append('\n'); break;
+            case 'r': utf8.append('\r'); break;
+            case 't': utf8.append('\t'); break;
+            case 'u': {
+                if (i + 4 >= raw.size())
+                    return fail("invalid escape sequence");
+
+                ushort code = 0;
+                for (int j = 1; j <= 4; j++) {
+                    int digit = hexValue(raw.at(i + j));
+                    if (digit < 0)
+                        return fail("invalid escape sequence");
+
+                    code = (code << 4) | digit;
+                }
+                i += 4;
+
+                // Combine surrogate pairs, lone surrogates are kept as they are
+                QString character(QChar(code));
+                if (QChar::isHighSurrogate(code) && i + 6 < raw.size() && raw.at(i + 1) == '\\' && raw.at(i + 2) == 'u') {
+                    ushort low = 0;
+                    bool valid = true;
+                    for (int j = 3; j <= 6; j++) {
+                        int digit = hexValue(raw.at(i + j));
+                        if (digit < 0)
+                            valid = false;
+
+                        low = (low << 4) | (digit & 0xf);
+                    }
+                    if (valid && QChar::isLowSurrogate(low)) {
+                        character.append(QChar(low));
+                        i += 6;
+                    }
+                }
+                utf8.append(character.toUtf8());
+                break;
+            }
+            default:
+                return fail("invalid escape sequence");
+            }
+        }
+
+        *string = QString::fromUtf8(utf8);
+        return true;
+    }
+};
+
+bool JsonStateMapper::map(const QByteArray &data, const QHash<QByteArray, StateField> &fields, QList<StateValue> *values, QString *errorString)
+{
+    JsonScanner scanner(data);
+    bool ok = scanner.expect('{');
+
+    if (ok && scanner.peek('}')) {
+        ok = scanner.expect('}');
+    } else {
+        while (ok) {
+            QByteArray key;
+            if (!scanner.readKey(&key) || !scanner.expect(':')) {
+                ok = false;
+                break;
+            }
+
+            // Decode only the values we have a state for
+            QHash<QByteArray, StateField>::const_iterator field = fields.constFind(key);
+            if (field == fields.constEnd()) {
+                ok = scanner.skipValue();
+            } else {
+                QVariant value;
+                ok = scanner.readValue(&value);
+                if (ok && value.isValid() && value.convert(field->type))
+                    values->append(StateValue{field->stateTypeId, value});
+            }
+
+            if (!ok || scanner.peek('}'))
+                break;
+
+            ok = scanner.expect(',');
+        }
+        ok = ok && scanner.expect('}');
+    }
+
+    if (ok && !scanner.atEnd())
+        ok = false;
+
+    if (!ok && errorString)
+        *errorString = QString::fromLatin1(scanner.error() ? scanner.error() : "trailing data");
+
+    return ok;
+}
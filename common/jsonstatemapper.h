@@ -0,0 +1,44 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef JSONSTATEMAPPER_H
+#define JSONSTATEMAPPER_H
+
+#include "plugintables.h"
+
+#include <QByteArray>
+#include <QVariant>
+#include <QList>
+
+// Maps the members of a flat JSON object to states using the generated
+// <deviceClass>StateFields() table. The data is scanned once, only the mapped
+// members are decoded and all other values are skipped without being copied.
+class JsonStateMapper
+{
+public:
+    struct StateValue {
+        StateTypeId stateTypeId;
+        QVariant value;
+    };
+
+    static bool map(const QByteArray &data, const QHash<QByteArray, StateField> &fields, QList<StateValue> *values, QString *errorString = 0);
+};
+
+#endif // JSONSTATEMAPPER_H
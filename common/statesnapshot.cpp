@@ -0,0 +1,326 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "statesnapshot.h"
+
+#include <QtEndian>
+#include <QDataStream>
+#include <QDateTime>
+#include <QSaveFile>
+
+static const quint32 snapshotMagic = 0x47534e50;
+// Bump this whenever the layout of the snapshot file changes
+static const quint32 snapshotVersion = 1;
+static const qint64 headerSize = 8;
+
+static QByteArray snapshotHeader()
+{
+    QByteArray header(headerSize, 0);
+    qToLittleEndian<quint32>(snapshotMagic, reinterpret_cast<uchar *>(header.data()));
+    qToLittleEndian<quint32>(snapshotVersion, reinterpret_cast<uchar *>(header.data()) + 4);
+    return header;
+}
+
+StateSnapshot::StateSnapshot(const QString &fileName, LoggingCategory category, QObject *parent) :
+    QObject(parent),
+    m_category(category),
+    m_data(0),
+    m_mappedSize(0),
+    m_size(0),
+    m_recordCount(0)
+{
+    m_file.setFileName(fileName);
+
+    // Collect changes for a few seconds, many states change at once
+    m_saveTimer = new QTimer(this);
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(5000);
+    connect(m_saveTimer, &QTimer::timeout, this, &StateSnapshot::save);
+
+    load();
+}
+
+StateSnapshot::~StateSnapshot()
+{
+    save();
+}
+
+// Sets the stored values of the given states, returns how many states were restored
+int StateSnapshot::restore(Device *device, const QList<StateTypeId> &stateTypeIds)
+{
+    // Changes which are not written yet are newer than the file, they are left for the save timer
+    QHash<StateTypeId, int> pending;
+    bool removed = false;
+    for (int i = m_changes.count() - 1; i >= 0 && !removed; i--) {
+        const Change &change = m_changes.at(i);
+        if (change.deviceId != device->id())
+            continue;
+
+        // A record without state removed the states of the device in the file
+        removed = change.stateTypeId.isNull();
+        if (!removed && !pending.contains(change.stateTypeId))
+            pending.insert(change.stateTypeId, i);
+    }
+
+    QHash<DeviceId, QHash<StateTypeId, qint64> >::const_iterator states = m_index.constFind(device->id());
+    if (removed)
+        states = m_index.constEnd();
+
+    if (pending.isEmpty() && states == m_index.constEnd())
+        return 0;
+
+    int restored = 0;
+    qint64 timestamp = 0;
+    foreach (const StateTypeId &stateTypeId, stateTypeIds) {
+        Change change;
+        if (pending.contains(stateTypeId)) {
+            change = m_changes.at(pending.value(stateTypeId));
+        } else {
+            qint64 offset = states == m_index.constEnd() ? -1 : states.value().value(stateTypeId, -1);
+            if (offset < 0 || !readRecord(offset, &change, 0))
+                continue;
+        }
+
+        device->setStateValue(stateTypeId, change.value);
+        timestamp = qMax(timestamp, change.timestamp);
+        restored++;
+    }
+
+    qCDebug(m_category) << "Restored" << restored << "states of" << device->name() << "from" << QDateTime::fromMSecsSinceEpoch(timestamp).toString(Qt::ISODate);
+    return restored;
+}
+
+// Records the changes of the given states of the device
+void StateSnapshot::track(Device *device, const QList<StateTypeId> &stateTypeIds)
+{
+    DeviceId deviceId = device->id();
+    connect(device, &Device::stateValueChanged, this, [this, deviceId, stateTypeIds](const QUuid &stateTypeId, const QVariant &value) {
+        if (!stateTypeIds.contains(StateTypeId(stateTypeId)))
+            return;
+
+        Change change;
+        change.deviceId = deviceId;
+        change.stateTypeId = StateTypeId(stateTypeId);
+        change.timestamp = QDateTime::currentMSecsSinceEpoch();
+        change.value = value;
+        m_changes.append(change);
+
+        // Don't restart the timer, states which change often would delay the save forever
+        if (!m_saveTimer->isActive())
+            m_saveTimer->start();
+    });
+}
+
+void StateSnapshot::remove(const DeviceId &deviceId)
+{
+    for (int i = m_changes.count() - 1; i >= 0; i--) {
+        if (m_changes.at(i).deviceId == deviceId)
+            m_changes.removeAt(i);
+    }
+
+    if (!m_index.contains(deviceId))
+        return;
+
+    // A record without state removes all states of the device
+    Change change;
+    change.deviceId = deviceId;
+    change.timestamp = QDateTime::currentMSecsSinceEpoch();
+    m_changes.append(change);
+
+    if (!m_saveTimer->isActive())
+        m_saveTimer->start();
+}
+
+void StateSnapshot::load()
+{
+    // Closing the file unmaps the data
+    m_file.close();
+    m_data = 0;
+    m_mappedSize = 0;
+    m_size = headerSize;
+    m_recordCount = 0;
+    m_index.clear();
+
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qCWarning(m_category) << "Could not open state snapshot" << m_file.fileName() << m_file.errorString();
+        return;
+    }
+
+    map();
+    if (m_mappedSize >= headerSize && qFromLittleEndian<quint32>(m_data) == snapshotMagic && qFromLittleEndian<quint32>(m_data + 4) == snapshotVersion) {
+        index(headerSize);
+        qCDebug(m_category) << "Loaded" << m_recordCount << "records of" << m_index.count() << "devices from" << m_file.fileName();
+        return;
+    }
+
+    if (m_mappedSize > 0)
+        qCWarning(m_category) << "Ignoring state snapshot" << m_file.fileName() << "with unknown format";
+
+    // Start a new file
+    m_file.resize(0);
+    m_file.seek(0);
+    m_file.write(snapshotHeader());
+    m_file.flush();
+    map();
+}
+
+void StateSnapshot::map()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+
+    m_mappedSize = m_file.size();
+    m_data = m_mappedSize > 0 ? m_file.map(0, m_mappedSize) : 0;
+    if (!m_data)
+        m_mappedSize = 0;
+}
+
+// Indexes the records starting at the given offset, stops at the first incomplete record
+void StateSnapshot::index(qint64 offset)
+{
+    Change change;
+    qint64 next = 0;
+    while (readRecord(offset, &change, &next, false)) {
+        if (change.stateTypeId.isNull()) {
+            m_index.remove(change.deviceId);
+        } else {
+            m_index[change.deviceId].insert(change.stateTypeId, offset);
+        }
+
+        m_recordCount++;
+        offset = next;
+    }
+    m_size = offset;
+}
+
+// Record: quint32 length, QUuid device, QUuid state, qint64 timestamp, QVariant value
+bool StateSnapshot::readRecord(qint64 offset, Change *change, qint64 *next, bool readValue) const
+{
+    if (offset + 4 > m_mappedSize)
+        return false;
+
+    quint32 length = qFromLittleEndian<quint32>(m_data + offset);
+    if (offset + 4 + length > m_mappedSize)
+        return false;
+
+    QDataStream stream(QByteArray::fromRawData(reinterpret_cast<const char *>(m_data + offset + 4), length));
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    QUuid deviceId;
+    QUuid stateTypeId;
+    stream >> deviceId >> stateTypeId >> change->timestamp;
+    if (readValue)
+        stream >> change->value;
+
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    change->deviceId = DeviceId(deviceId);
+    change->stateTypeId = StateTypeId(stateTypeId);
+    if (next)
+        *next = offset + 4 + length;
+
+    return true;
+}
+
+QByteArray StateSnapshot::record(const Change &change)
+{
+    QByteArray data(4, 0);
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.device()->seek(4);
+    stream << QUuid(change.deviceId) << QUuid(change.stateTypeId) << change.timestamp << change.value;
+
+    qToLittleEndian<quint32>(data.size() - 4, reinterpret_cast<uchar *>(data.data()));
+    return data;
+}
+
+void StateSnapshot::save()
+{
+    m_saveTimer->stop();
+    if (m_changes.isEmpty() || !m_file.isOpen())
+        return;
+
+    // Only the last change of each state has to be written
+    QHash<QPair<QUuid, QUuid>, int> last;
+    for (int i = 0; i < m_changes.count(); i++) {
+        last.insert(qMakePair(QUuid(m_changes.at(i).deviceId), QUuid(m_changes.at(i).stateTypeId)), i);
+    }
+
+    QByteArray data;
+    for (int i = 0; i < m_changes.count(); i++) {
+        const Change &change = m_changes.at(i);
+        if (last.value(qMakePair(QUuid(change.deviceId), QUuid(change.stateTypeId))) == i)
+            data.append(record(change));
+    }
+    m_changes.clear();
+
+    // Drop an incomplete record a crash may have left behind and append the new ones
+    if (m_file.size() != m_size)
+        m_file.resize(m_size);
+
+    if (!m_file.seek(m_size) || m_file.write(data) != data.size() || !m_file.flush()) {
+        qCWarning(m_category) << "Could not write state snapshot" << m_file.fileName() << m_file.errorString();
+        load();
+        return;
+    }
+
+    qint64 offset = m_size;
+    map();
+    index(offset);
+
+    // Rewrite the file once most records are outdated
+    int liveRecords = 0;
+    foreach (const QHash<StateTypeId, qint64> &states, m_index) {
+        liveRecords += states.count();
+    }
+
+    if (m_recordCount > 2 * liveRecords + 64)
+        compact();
+}
+
+void StateSnapshot::compact()
+{
+    // Write to a temporary file first so a crash can't leave a half written snapshot behind
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(m_category) << "Could not compact state snapshot" << m_file.fileName() << file.errorString();
+        return;
+    }
+
+    file.write(snapshotHeader());
+
+    // The live records are copied as they are
+    foreach (const QHash<StateTypeId, qint64> &states, m_index) {
+        foreach (qint64 offset, states) {
+            quint32 length = qFromLittleEndian<quint32>(m_data + offset);
+            file.write(reinterpret_cast<const char *>(m_data + offset), 4 + length);
+        }
+    }
+
+    if (!file.commit()) {
+        qCWarning(m_category) << "Could not compact state snapshot" << m_file.fileName() << file.errorString();
+        return;
+    }
+
+    load();
+}
@@ -0,0 +1,86 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef STATESNAPSHOT_H
+#define STATESNAPSHOT_H
+
+#include "plugin/device.h"
+
+#include <QObject>
+#include <QHash>
+#include <QFile>
+#include <QTimer>
+#include <QLoggingCategory>
+
+// Persistent snapshot of the last known states of the devices of a plugin.
+//
+// Changes are appended to the file as records, the last record of a state wins.
+// At load the file is memory mapped and indexed per device, so restoring the
+// states of a device is a hash lookup and decodes only the values of this device.
+// Changes are written by the save timer only, restoring never touches the file.
+// The file is compacted once most of its records are outdated.
+class StateSnapshot : public QObject
+{
+    Q_OBJECT
+public:
+    // The logging category of the plugin, e.g. dcCoapClient from its plugininfo.h
+    typedef const QLoggingCategory &(*LoggingCategory)();
+
+    StateSnapshot(const QString &fileName, LoggingCategory category, QObject *parent = 0);
+    ~StateSnapshot();
+
+    int restore(Device *device, const QList<StateTypeId> &stateTypeIds);
+    void track(Device *device, const QList<StateTypeId> &stateTypeIds);
+    void remove(const DeviceId &deviceId);
+
+private:
+    struct Change {
+        DeviceId deviceId;
+        StateTypeId stateTypeId;
+        qint64 timestamp;
+        QVariant value;
+    };
+
+    LoggingCategory m_category;
+
+    QFile m_file;
+    uchar *m_data;
+    qint64 m_mappedSize;
+    qint64 m_size;
+    int m_recordCount;
+
+    // Offset of the last record of each state
+    QHash<DeviceId, QHash<StateTypeId, qint64> > m_index;
+
+    QList<Change> m_changes;
+    QTimer *m_saveTimer;
+
+    void load();
+    void map();
+    void index(qint64 offset);
+    bool readRecord(qint64 offset, Change *change, qint64 *next, bool readValue = true) const;
+    static QByteArray record(const Change &change);
+    void compact();
+
+private slots:
+    void save();
+};
+
+#endif // STATESNAPSHOT_H
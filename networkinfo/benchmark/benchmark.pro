@@ -0,0 +1,22 @@
+# Benchmarks of the NetworkInfo plugin, see main.cpp.
+# Build the plugin first, the update benchmark loads it from the parent directory.
+JSONFILES = ../devicepluginnetworkinfo.json
+
+include(../../common/benchmark/benchmark.pri)
+
+TARGET = networkinfo-benchmark
+
+SOURCES += \
+    main.cpp \
+    httpstandinserver.cpp \
+    jsonmapperbenchmark.cpp \
+    locationpayload.cpp \
+    networkinfobenchmark.cpp \
+    ../../common/jsonstatemapper.cpp \
+
+HEADERS += \
+    httpstandinserver.h \
+    jsonmapperbenchmark.h \
+    locationpayload.h \
+    networkinfobenchmark.h \
+    ../../common/jsonstatemapper.h \
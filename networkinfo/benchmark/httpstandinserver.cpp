@@ -0,0 +1,189 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "httpstandinserver.h"
+#include "locationpayload.h"
+
+#include <QPointer>
+#include <QTimer>
+
+HttpStandInServer::HttpStandInServer(QObject *parent) :
+    QObject(parent),
+    m_delay(0),
+    m_payloadSize(0),
+    m_errorRate(0),
+    m_random(1),
+    m_locationChangeInterval(1),
+    m_requestCount(0),
+    m_errorCount(0),
+    m_notModifiedCount(0)
+{
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &HttpStandInServer::onNewConnection);
+}
+
+// Starts listening, port 0 picks a free port
+bool HttpStandInServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (!m_server->listen(address, port)) {
+        qWarning() << "Could not start the HTTP server on" << address.toString() << port << m_server->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the URL of the location resource for the "location providers" param
+QUrl HttpStandInServer::url() const
+{
+    QUrl url;
+    url.setScheme("http");
+    url.setHost(m_server->serverAddress().toString());
+    url.setPort(m_server->serverPort());
+    url.setPath("/json");
+    return url;
+}
+
+// Time between receiving a request and sending its answer
+void HttpStandInServer::setDelay(int milliSeconds)
+{
+    m_delay = milliSeconds;
+}
+
+// Minimum size of the location answers, 0 sends them without padding
+void HttpStandInServer::setPayloadSize(int bytes)
+{
+    m_payloadSize = bytes;
+}
+
+// Share of the requests answered with 503 Service Unavailable
+void HttpStandInServer::setErrorRate(double probability)
+{
+    m_errorRate = qBound(0.0, probability, 1.0);
+}
+
+// The same seed fails the same requests
+void HttpStandInServer::setSeed(quint32 seed)
+{
+    m_random.seed(seed);
+}
+
+// The location moves every given number of requests, in between the answers stay the same
+void HttpStandInServer::setLocationChangeInterval(int requests)
+{
+    m_locationChangeInterval = qMax(1, requests);
+}
+
+int HttpStandInServer::requestCount() const
+{
+    return m_requestCount;
+}
+
+int HttpStandInServer::errorCount() const
+{
+    return m_errorCount;
+}
+
+int HttpStandInServer::notModifiedCount() const
+{
+    return m_notModifiedCount;
+}
+
+void HttpStandInServer::handleRequest(QTcpSocket *socket, const QByteArray &request)
+{
+    QByteArray data = response(request);
+    bool close = request.toLower().contains("\r\nconnection: close");
+
+    QPointer<QTcpSocket> client(socket);
+    QTimer::singleShot(m_delay, this, [client, data, close]() {
+        if (!client)
+            return;
+
+        client->write(data);
+        if (close)
+            client->disconnectFromHost();
+    });
+}
+
+// Returns the complete answer to the request header
+QByteArray HttpStandInServer::response(const QByteArray &request)
+{
+    m_requestCount++;
+
+    QByteArray status;
+    QByteArray headers;
+    QByteArray body;
+
+    if (!request.startsWith("GET ")) {
+        status = "405 Method Not Allowed";
+    } else if (m_errorRate > 0 && std::uniform_real_distribution<double>(0, 1)(m_random) < m_errorRate) {
+        m_errorCount++;
+        status = "503 Service Unavailable";
+    } else {
+        // The requests of one interval get the same location and the same tag
+        int sequence = (m_requestCount - 1) / m_locationChangeInterval;
+        QByteArray entityTag = "\"" + QByteArray::number(sequence) + "\"";
+        headers = "ETag: " + entityTag + "\r\n";
+
+        if (request.contains("\r\nIf-None-Match: " + entityTag + "\r\n")) {
+            m_notModifiedCount++;
+            status = "304 Not Modified";
+        } else {
+            status = "200 OK";
+            headers += "Content-Type: application/json; charset=utf-8\r\n";
+            body = LocationPayload::create(sequence, m_payloadSize);
+        }
+    }
+
+    return "HTTP/1.1 " + status + "\r\n" + headers + "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+}
+
+void HttpStandInServer::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        m_buffers.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, &HttpStandInServer::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &HttpStandInServer::onDisconnected);
+    }
+}
+
+// Splits the received data into requests, the client may reuse the connection
+void HttpStandInServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // The requests are GETs without a body
+    int end = buffer.indexOf("\r\n\r\n");
+    while (end >= 0) {
+        handleRequest(socket, buffer.left(end + 2));
+        buffer.remove(0, end + 4);
+        end = buffer.indexOf("\r\n\r\n");
+    }
+}
+
+void HttpStandInServer::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    m_buffers.remove(socket);
+    socket->deleteLater();
+}
@@ -0,0 +1,78 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HTTPSTANDINSERVER_H
+#define HTTPSTANDINSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include <QUrl>
+
+#include <random>
+
+// HTTP server on localhost standing in for the location providers in the benchmarks.
+// Every GET is answered with an ip-api.com style location (see LocationPayload) after
+// the configured delay. Answers carry an ETag, a matching If-None-Match gets a 304.
+// A share of the requests can be answered with an error instead.
+class HttpStandInServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HttpStandInServer(QObject *parent = 0);
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 0);
+    QUrl url() const;
+
+    void setDelay(int milliSeconds);
+    void setPayloadSize(int bytes);
+    void setErrorRate(double probability);
+    void setSeed(quint32 seed);
+    void setLocationChangeInterval(int requests);
+
+    int requestCount() const;
+    int errorCount() const;
+    int notModifiedCount() const;
+
+private:
+    QTcpServer *m_server;
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+
+    int m_delay;
+    int m_payloadSize;
+    double m_errorRate;
+    std::minstd_rand m_random;
+    int m_locationChangeInterval;
+
+    int m_requestCount;
+    int m_errorCount;
+    int m_notModifiedCount;
+
+    void handleRequest(QTcpSocket *socket, const QByteArray &request);
+    QByteArray response(const QByteArray &request);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+};
+
+#endif // HTTPSTANDINSERVER_H
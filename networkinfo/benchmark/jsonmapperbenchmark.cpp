@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "jsonmapperbenchmark.h"
+#include "jsonstatemapper.h"
+#include "locationpayload.h"
+
+#include <QJsonDocument>
+#include <QVariantMap>
+
+// The plugin before the mapper: parse the whole document, convert it to a map and pick the fields
+static bool mapWithVariantMap(const QByteArray &data, QList<JsonStateMapper::StateValue> *values)
+{
+    QJsonParseError error;
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError)
+        return false;
+
+    QVariantMap dataMap = jsonDoc.toVariant().toMap();
+
+    const char *names[] = { "city", "countryCode", "query", "timezone", "lon", "lat" };
+    for (const char *name : names) {
+        if (!dataMap.contains(name))
+            continue;
+
+        const StateField &field = infoStateFields().value(name);
+        JsonStateMapper::StateValue value;
+        value.stateTypeId = field.stateTypeId;
+        value.value = dataMap.value(name);
+        value.value.convert(field.type);
+        values->append(value);
+    }
+
+    return true;
+}
+
+QList<BenchmarkResult> JsonMapperBenchmark::run(const QList<int> &sizes, int iterations)
+{
+    QList<BenchmarkResult> results;
+
+    foreach (int size, sizes) {
+        QByteArray payload = LocationPayload::create(0, size);
+        QString suffix = QString(" %1 bytes").arg(payload.size());
+
+        results << BenchmarkResult::measure("QJsonDocument" + suffix, iterations, [&payload](int) {
+            QList<JsonStateMapper::StateValue> values;
+            return mapWithVariantMap(payload, &values) && values.count() == 6;
+        });
+
+        results << BenchmarkResult::measure("JsonStateMapper" + suffix, iterations, [&payload](int) {
+            QList<JsonStateMapper::StateValue> values;
+            return JsonStateMapper::map(payload, infoStateFields(), &values) && values.count() == 6;
+        });
+    }
+
+    return results;
+}
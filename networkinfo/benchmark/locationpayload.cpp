@@ -0,0 +1,50 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "locationpayload.h"
+
+// Returns an answer of at least size bytes. The sequence number moves the location,
+// the same sequence number gives the same answer. Larger answers carry a member
+// in front of the mapped ones, which the parsers have to skip.
+QByteArray LocationPayload::create(int sequence, int size)
+{
+    QByteArray location;
+    location.append("\"as\":\"AS8447 A1 Telekom Austria AG\",\"city\":\"Graz\",\"country\":\"Austria\",\"countryCode\":\"AT\",");
+    location.append("\"isp\":\"A1 Telekom Austria\",\"lat\":");
+    location.append(QByteArray::number(47.0667 + (sequence % 100) * 0.001, 'f', 4));
+    location.append(",\"lon\":");
+    location.append(QByteArray::number(15.45 + (sequence % 100) * 0.001, 'f', 4));
+    location.append(",\"org\":\"A1 Telekom Austria\",\"query\":\"80.110.");
+    location.append(QByteArray::number((sequence / 256) % 256));
+    location.append('.');
+    location.append(QByteArray::number(sequence % 256));
+    location.append("\",\"region\":\"6\",\"regionName\":\"Styria\",\"status\":\"success\",\"timezone\":\"Europe/Vienna\",\"zip\":\"8010\"}");
+
+    QByteArray payload("{");
+    int padding = size - location.size() - 16;
+    if (padding > 0) {
+        payload.append("\"padding\":\"");
+        payload.append(QByteArray(padding, 'x'));
+        payload.append("\",");
+    }
+
+    payload.append(location);
+    return payload;
+}
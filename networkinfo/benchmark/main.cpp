@@ -0,0 +1,111 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "plugininfo.h"
+#include "jsonmapperbenchmark.h"
+#include "networkinfobenchmark.h"
+#include "httpstandinserver.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+// Benchmarks of the NetworkInfo plugin
+//
+//   networkinfo-benchmark [options] [update] [jsonmapper]
+//
+// Prints p50/p99 latency, operations per second and allocations per operation.
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    application.setApplicationName("networkinfo-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the NetworkInfo plugin.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("benchmarks", "The benchmarks to run: update, jsonmapper (default: all).");
+
+    QCommandLineOption pluginPathOption("plugin-path", "Directory of the built plugin.", "path", QCoreApplication::applicationDirPath() + "/..");
+    QCommandLineOption devicesOption("devices", "Number of devices.", "count", "10");
+    QCommandLineOption updatesOption("updates", "Number of update actions.", "count", "10000");
+    QCommandLineOption concurrencyOption("concurrency", "Actions running at the same time.", "count", "16");
+    QCommandLineOption delayOption("delay", "Answer delay of the HTTP server in milliseconds.", "ms", "0");
+    QCommandLineOption sizeOption("size", "Minimum size of the location answers in bytes.", "bytes", "0");
+    QCommandLineOption errorRateOption("error-rate", "Share of the requests answered with an error, in percent.", "percent", "0");
+    QCommandLineOption changeOption("change-interval", "Requests until the location changes.", "count", "1");
+    QCommandLineOption seedOption("seed", "Seed of the server errors.", "seed", "1");
+    QCommandLineOption timeoutOption("timeout", "Time limit of each benchmark in milliseconds.", "ms", "120000");
+    QCommandLineOption iterationsOption("iterations", "Iterations of the parser benchmarks.", "count", "10000");
+    parser.addOptions(QList<QCommandLineOption>() << pluginPathOption << devicesOption << updatesOption << concurrencyOption
+                      << delayOption << sizeOption << errorRateOption << changeOption << seedOption << timeoutOption
+                      << iterationsOption);
+    parser.process(application);
+
+    QStringList benchmarks = parser.positionalArguments();
+    if (benchmarks.isEmpty())
+        benchmarks << "update" << "jsonmapper";
+
+    QList<BenchmarkResult> results;
+    if (benchmarks.contains("jsonmapper"))
+        results << JsonMapperBenchmark::run(QList<int>() << 0 << 4096 << 65536, parser.value(iterationsOption).toInt());
+
+    HttpStandInServer server;
+    server.setDelay(parser.value(delayOption).toInt());
+    server.setPayloadSize(parser.value(sizeOption).toInt());
+    server.setErrorRate(parser.value(errorRateOption).toDouble() / 100);
+    server.setLocationChangeInterval(parser.value(changeOption).toInt());
+    server.setSeed(parser.value(seedOption).toUInt());
+
+    PluginBenchmarkHost host(infoDeviceClassId);
+    QStringList stateChanges;
+    if (benchmarks.contains("update")) {
+        if (!server.listen() || !host.load(parser.value(pluginPathOption)))
+            return 1;
+
+        NetworkInfoBenchmark::Options options;
+        options.devices = qMax(1, parser.value(devicesOption).toInt());
+        options.updates = parser.value(updatesOption).toInt();
+        options.concurrency = qMax(1, parser.value(concurrencyOption).toInt());
+        options.timeout = parser.value(timeoutOption).toInt();
+
+        NetworkInfoBenchmark benchmark(&host, &server, options);
+        results << benchmark.runSetup();
+        results << benchmark.runUpdate();
+        stateChanges = benchmark.stateChanges();
+    }
+
+    QTextStream out(stdout);
+    out << BenchmarkResult::header() << endl;
+    foreach (const BenchmarkResult &result, results) {
+        out << result.toString() << endl;
+    }
+
+    out << endl;
+    if (benchmarks.contains("update")) {
+        out << "server: " << server.requestCount() << " requests, " << server.notModifiedCount() << " not modified, "
+            << server.errorCount() << " errors" << endl;
+    }
+
+    foreach (const QString &line, stateChanges) {
+        out << line << endl;
+    }
+    out << "peak memory: " << AllocationCounter::peakMemory() / 1024 << " KiB" << endl;
+    return 0;
+}
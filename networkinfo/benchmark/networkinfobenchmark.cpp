@@ -0,0 +1,86 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "networkinfobenchmark.h"
+#include "extern-plugininfo.h"
+
+NetworkInfoBenchmark::NetworkInfoBenchmark(PluginBenchmarkHost *host, HttpStandInServer *server, const Options &options, QObject *parent) :
+    QObject(parent),
+    m_host(host),
+    m_server(server),
+    m_options(options)
+{
+}
+
+QList<BenchmarkResult> NetworkInfoBenchmark::runSetup()
+{
+    // Only the stand-in server, without hedging and periodic refreshes
+    m_host->setPluginConfig("location providers", "standin=" + m_server->url().toString());
+    m_host->setPluginConfig("hedge percentile", 0);
+    m_host->setPluginConfig("refresh interval", 0);
+
+    BenchmarkResult setup = m_host->addDevices("setupDevice", m_options.devices, m_options.concurrency, infoDeviceClassId,
+                                               [](int index) { return ParamList() << Param("name", QString("benchmark %1").arg(index)); },
+                                               m_options.timeout);
+
+    return QList<BenchmarkResult>() << setup;
+}
+
+// Updates with every action asking the server, concurrent actions share one request,
+// and with the answers coming from the cache of the plugin
+QList<BenchmarkResult> NetworkInfoBenchmark::runUpdate()
+{
+    QList<BenchmarkResult> results;
+    if (m_host->devices().isEmpty())
+        return results;
+
+    m_host->setPluginConfig("cache lifetime", 0);
+    results << executeUpdates("update");
+
+    m_host->setPluginConfig("cache lifetime", 3600);
+    results << executeUpdates("update cached");
+    return results;
+}
+
+// Returns the state change notifications of each update run, the fan-out to the core,
+// the clients and the rule engine
+QStringList NetworkInfoBenchmark::stateChanges() const
+{
+    return m_stateChanges;
+}
+
+BenchmarkResult NetworkInfoBenchmark::executeUpdates(const QString &name)
+{
+    int stateChanges = 0;
+    QMetaObject::Connection connection = connect(m_host->deviceManager(), &DeviceManager::deviceStateChanged, [&stateChanges]() {
+        stateChanges++;
+    });
+
+    QList<Device *> devices = m_host->devices();
+    BenchmarkResult result = m_host->executeActions(name, m_options.updates, m_options.concurrency, [devices](int index) {
+        return Action(updateActionTypeId, devices.at(index % devices.count())->id());
+    }, m_options.timeout);
+
+    disconnect(connection);
+
+    double perUpdate = result.count() > 0 ? double(stateChanges) / result.count() : 0;
+    m_stateChanges << QString("%1: %2 state changes, %3 per update").arg(name).arg(stateChanges).arg(perUpdate, 0, 'f', 2);
+    return result;
+}
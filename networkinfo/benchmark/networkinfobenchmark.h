@@ -0,0 +1,60 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef NETWORKINFOBENCHMARK_H
+#define NETWORKINFOBENCHMARK_H
+
+#include "pluginbenchmarkhost.h"
+#include "httpstandinserver.h"
+
+#include <QObject>
+#include <QStringList>
+
+// Drives update actions of the NetworkInfo plugin through networkManagerReplyReady,
+// with the HTTP stand-in server as the only location provider
+class NetworkInfoBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        Options() : devices(10), updates(10000), concurrency(16), timeout(120000) { }
+        int devices;
+        int updates;
+        int concurrency;
+        int timeout;
+    };
+
+    NetworkInfoBenchmark(PluginBenchmarkHost *host, HttpStandInServer *server, const Options &options, QObject *parent = 0);
+
+    QList<BenchmarkResult> runSetup();
+    QList<BenchmarkResult> runUpdate();
+
+    QStringList stateChanges() const;
+
+private:
+    PluginBenchmarkHost *m_host;
+    HttpStandInServer *m_server;
+    Options m_options;
+    QStringList m_stateChanges;
+
+    BenchmarkResult executeUpdates(const QString &name);
+};
+
+#endif // NETWORKINFOBENCHMARK_H
@@ -20,18 +20,35 @@
 
 #include "devicepluginnetworkinfo.h"
 #include "plugininfo.h"
+#include "plugintables.h"
+#include "guhsettings.h"
 
-#include <QJsonDocument>
+#include <algorithm>
 
 // Note: You can find the documentation for this code here -> http://dev.guh.guru/write-plugins.html
 
 // The constructor of this device plugin.
-DevicePluginNetworkInfo::DevicePluginNetworkInfo()
+DevicePluginNetworkInfo::DevicePluginNetworkInfo() :
+    m_locationProvider(-1),
+    m_random(std::random_device()())
 {
+    m_clock.start();
+
+    m_hedgeTimer = new QTimer(this);
+    m_hedgeTimer->setSingleShot(true);
+
+    connect(m_hedgeTimer, &QTimer::timeout, this, &DevicePluginNetworkInfo::onHedgeTimeout);
+
+    m_stateSnapshot = new StateSnapshot(GuhSettings::settingsPath() + "/networkinfo-states.snapshot", dcNetworkInfo, this);
 }
 
 DeviceManager::HardwareResources DevicePluginNetworkInfo::requiredHardware() const
 {
+    // The timer is only needed for the periodic refreshes. The resources are requested once
+    // when the plugin is loaded, so enabling the refreshes takes effect after a restart.
+    if (refreshInterval() > 0)
+        return DeviceManager::HardwareResourceNetworkManager | DeviceManager::HardwareResourceTimer;
+
     return DeviceManager::HardwareResourceNetworkManager;
 }
 
@@ -41,43 +58,144 @@ DeviceManager::DeviceSetupStatus DevicePluginNetworkInfo::setupDevice(Device *de
     qCDebug(dcNetworkInfo) << "Setting up a new device:" << device->name() << device->id();
     qCDebug(dcNetworkInfo) << device->params();
 
+    // Start from the last known location until the first update finishes
+    QList<StateTypeId> stateTypeIds;
+    foreach (const StateField &field, infoStateFields()) {
+        stateTypeIds.append(field.stateTypeId);
+    }
+    m_stateSnapshot->restore(device, stateTypeIds);
+    m_stateSnapshot->track(device, stateTypeIds);
+
+    // Open the local GeoIP database
+    QString databaseFile = configValue("geoip database").toString();
+    if (databaseFile.isEmpty()) {
+        m_geoIpDatabase.close();
+    } else if (!m_geoIpDatabase.isOpen() || m_geoIpDatabase.fileName() != databaseFile) {
+        m_geoIpDatabase.open(databaseFile);
+    }
+
     return DeviceManager::DeviceSetupStatusSuccess;
 }
 
+void DevicePluginNetworkInfo::deviceRemoved(Device *device)
+{
+    // Forget the pending actions and refreshes of this device
+    foreach (const ActionId &actionId, m_asyncActions.keys(device)) {
+        m_asyncActions.remove(actionId);
+    }
+
+    m_refreshingDevices.removeAll(device);
+    m_upToDateDevices.removeAll(device);
+    m_nextRefresh.remove(device);
+
+    m_stateSnapshot->remove(device->id());
+}
+
+// This method will be called periodically by the device manager
+void DevicePluginNetworkInfo::guhTimer()
+{
+    qint64 interval = refreshInterval();
+    if (interval <= 0)
+        return;
+
+    qint64 now = m_clock.elapsed();
+
+    // Schedule the devices set up since the last tick or while the refreshes were disabled.
+    // Their phases spread the refreshes over the whole interval.
+    foreach (Device *device, myDevices()) {
+        if (!m_nextRefresh.contains(device))
+            m_nextRefresh.insert(device, now + refreshPhase(device, interval));
+    }
+
+    QHash<Device *, qint64>::iterator it;
+    for (it = m_nextRefresh.begin(); it != m_nextRefresh.end(); ++it) {
+        if (it.value() > now)
+            continue;
+
+        // Keep the phase of the device and add some jitter, so the devices don't line up over time
+        it.value() += interval + refreshJitter(interval / 5) - interval / 10;
+        if (it.value() <= now)
+            it.value() = now + interval;
+
+        refreshDevice(it.key());
+    }
+}
+
 // This method will be called whenever the reply from a NetworkManager call is ready.
 void DevicePluginNetworkInfo::networkManagerReplyReady(QNetworkReply *reply)
 {
+    // Replies we cancelled because another provider was faster
+    if (m_abortedReplies.removeAll(reply) > 0) {
+        reply->deleteLater();
+        return;
+    }
+
     // Make shore this is our reply
-    if (!m_asyncActionReplies.keys().contains(reply))
+    if (!m_locationReplies.contains(reply))
         return;
 
-    // This is one of our action replies!!
+    // This is one of our location replies
+    LocationRequest request = m_locationReplies.take(reply);
+    LocationProvider &provider = m_providers[request.provider];
+    qint64 latency = m_clock.elapsed() - request.sentTime;
 
-    // Take the corresponding action from our hash
-    ActionId actionId = m_asyncActionReplies.take(reply);
+    DeviceManager::DeviceError error = DeviceManager::DeviceErrorNoError;
+    QByteArray entityTag = provider.entityTag;
+    QByteArray lastModified = provider.lastModified;
 
     // Check the status code of the reply
     if (reply->error()) {
 
         // Print the warning message
-        qCWarning(dcNetworkInfo) << "Reply error" << reply->errorString();
+        qCWarning(dcNetworkInfo) << "Reply error from" << provider.name << reply->errorString();
+        error = DeviceManager::DeviceErrorHardwareNotAvailable;
 
-        // The action execution is finished and was not successfully
-        emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareNotAvailable);
+    } else if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
 
-        // Important -> delete the reply to prevent a memory leak!
-        reply->deleteLater();
-        return;
-    }
+        // The location did not change since the last answer, no need to parse or set anything
+        qCDebug(dcNetworkInfo) << "Location data of" << provider.name << "not modified";
+        m_locationDataAge.start();
 
-    // The request was successfull, lets read the payload
-    QByteArray data = reply->readAll();
+    } else {
+
+        // The request was successfull, lets read the payload and the validators for the next request
+        QByteArray data = reply->readAll();
+        entityTag = reply->rawHeader("ETag");
+        lastModified = reply->rawHeader("Last-Modified");
+
+        // Process the data from the reply with the field mapping of this provider
+        QHash<QString, QHash<QByteArray, StateField> >::const_iterator fields = infoProviderStateFields().constFind(provider.name);
+        if (!locationDataReady(data, fields != infoProviderStateFields().constEnd() ? fields.value() : infoStateFields()))
+            error = DeviceManager::DeviceErrorHardwareFailure;
+    }
 
     // Important -> delete the reply to prevent a memory leak!
     reply->deleteLater();
 
-    // Process the data from the reply
-    actionDataReady(actionId, data);
+    if (error != DeviceManager::DeviceErrorNoError) {
+        // A failed provider counts as slow, so it will not be asked first next time
+        addProviderLatency(request.provider, qMax(latency, 2 * qint64(configValue("hedge delay").toInt())));
+
+        // Wait for the hedged request or ask the next provider right away
+        if (!m_locationReplies.isEmpty() || sendLocationRequest())
+            return;
+
+        // the action executions are finished, and were not successfully
+        m_hedgeTimer->stop();
+        finishAsyncActions(error);
+        return;
+    }
+
+    qCDebug(dcNetworkInfo) << "Location provider" << provider.name << "answered after" << latency << "ms";
+    addProviderLatency(request.provider, latency);
+    provider.entityTag = entityTag;
+    provider.lastModified = lastModified;
+    m_locationProvider = request.provider;
+
+    // The first valid answer wins
+    m_hedgeTimer->stop();
+    cancelLocationRequests();
+    finishAsyncActions(DeviceManager::DeviceErrorNoError);
 }
 
 // This method will be called whenever a client or the rule engine wants to execute an action for the given device.
@@ -85,95 +203,335 @@ DeviceManager::DeviceError DevicePluginNetworkInfo::executeAction(Device *device
 {
     qCDebug(dcNetworkInfo) << "Execute action" << device->id() << action.id() << action.params();
 
-    // check if this device is a Network info device using the DeviceClassId
-    if (device->deviceClassId() != infoDeviceClassId) {
-        return DeviceManager::DeviceErrorDeviceClassNotFound;
+    // Look up the execute<ActionType>() method for the DeviceClassId and ActionTypeId
+    ActionDispatch<DevicePluginNetworkInfo>::Handler handler = ActionDispatch<DevicePluginNetworkInfo>::handler(device->deviceClassId(), action.actionTypeId());
+    if (!handler) {
+        if (!ActionDispatch<DevicePluginNetworkInfo>::containsDeviceClass(device->deviceClassId()))
+            return DeviceManager::DeviceErrorDeviceClassNotFound;
+
+        return DeviceManager::DeviceErrorActionTypeNotFound;
+    }
+
+    return (this->*handler)(device, action);
+}
+
+// The "update" action of the Network info device
+DeviceManager::DeviceError DevicePluginNetworkInfo::executeUpdate(Device *device, const Action &action)
+{
+    // Print information that we are executing now the update action
+    qCDebug(dcNetworkInfo) << "Execute update action" << action.id();
+
+    // The location is the same for the whole gateway, answer from the local database or
+    // from the cache if it is still fresh
+    if (lookupLocation() || locationDataValid()) {
+        qCDebug(dcNetworkInfo) << "Using cached location data for action" << action.id();
+        setLocationStates(device);
+        return DeviceManager::DeviceErrorNoError;
     }
 
-    // check if the requested action is our "update" action ...
-    if (action.actionTypeId() == updateActionTypeId) {
+    // Only one request at a time, the others wait for its result
+    if (!requestLocation())
+        return DeviceManager::DeviceErrorHardwareNotAvailable;
 
-        // Print information that we are executing now the update action
-        qCDebug(dcNetworkInfo) << "Execute update action" << action.id();
+    // Hash the device for this action, because we dont get the result immediately
+    m_asyncActions.insert(action.id(), device);
 
-        // Create a network request
-        QNetworkRequest locationRequest(QUrl("http://ip-api.com/json"));
+    // Tell the DeviceManager that this is an async action and the result of the execution will
+    // be emitted later.
+    return DeviceManager::DeviceErrorAsync;
+}
+
+qint64 DevicePluginNetworkInfo::refreshInterval() const
+{
+    return configValue("refresh interval").toLongLong() * 1000;
+}
 
-        // Call the GET method from the NetworkManager
-        QNetworkReply *reply = networkManagerGet(locationRequest);
+// Returns the offset of the first refresh of the device in [0, interval). The device ids
+// are random, so the refreshes of different devices and gateways don't line up.
+qint64 DevicePluginNetworkInfo::refreshPhase(Device *device, qint64 interval) const
+{
+    return qint64(qHash(device->id())) % interval;
+}
 
-        // Hash the reply, because we dont get the result immediately
-        m_asyncActionReplies.insert(reply, action.id());
+// Returns a random delay in [0, range)
+qint64 DevicePluginNetworkInfo::refreshJitter(qint64 range)
+{
+    if (range <= 0)
+        return 0;
 
-        // Hash the device for this action
-        m_asyncActions.insert(action.id(), device);
+    return qint64(m_random() % quint64(range));
+}
 
-        // Tell the DeviceManager that this is an async action and the result of the execution will
-        // be emitted later.
-        return DeviceManager::DeviceErrorAsync;
+void DevicePluginNetworkInfo::refreshDevice(Device *device)
+{
+    qCDebug(dcNetworkInfo) << "Refresh" << device->name();
+
+    if (lookupLocation() || locationDataValid()) {
+        setLocationStates(device);
+        return;
     }
 
-    // ...otherwise the ActionType does not exist
-    return DeviceManager::DeviceErrorActionTypeNotFound;
+    if (!requestLocation())
+        return;
+
+    if (!m_refreshingDevices.contains(device))
+        m_refreshingDevices.append(device);
 }
 
-void DevicePluginNetworkInfo::actionDataReady(const ActionId &actionId, const QByteArray &data)
+// Reads the providers from the "location providers" param, a comma separated list of name=url entries
+// Only ip-api is configured by default. Further providers like "ipapi.co=https://ipapi.co/json/" get
+// the WAN address of the gateway as well, so hedging to them has to be enabled by the user.
+void DevicePluginNetworkInfo::updateProviders()
 {
-    // Convert the rawdata to a json document
-    QJsonParseError error;
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &error);
+    QString config = configValue("location providers").toString();
+    if (config == m_providerConfig)
+        return;
 
-    // Check if we got a valid JSON document
-    if(error.error != QJsonParseError::NoError) {
-        qCWarning(dcNetworkInfo) << "Failed to parse JSON data" << data << ":" << error.errorString();
+    m_providerConfig = config;
+    m_providers.clear();
+    m_locationProvider = -1;
 
-        // the action execution is finished, and was not successfully
-        emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorHardwareFailure);
-        return;
+    foreach (const QString &entry, config.split(',', QString::SkipEmptyParts)) {
+        int separator = entry.indexOf('=');
+        LocationProvider provider;
+        provider.name = entry.left(separator).trimmed();
+        provider.url = QUrl(entry.mid(separator + 1).trimmed());
+        if (separator < 0)
+            provider.name = provider.url.host();
+
+        if (!provider.url.isValid() || provider.url.isRelative()) {
+            qCWarning(dcNetworkInfo) << "Ignoring invalid location provider" << entry;
+            continue;
+        }
+
+        m_providers.append(provider);
+    }
+}
+
+// Returns the given percentile of the recent answer times of the provider
+qint64 DevicePluginNetworkInfo::providerLatency(const LocationProvider &provider, int percentile) const
+{
+    if (provider.latencies.isEmpty())
+        return 0;
+
+    QList<qint64> latencies = provider.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    return latencies.at((latencies.count() - 1) * percentile / 100);
+}
+
+void DevicePluginNetworkInfo::addProviderLatency(int provider, qint64 latency)
+{
+    QList<qint64> &latencies = m_providers[provider].latencies;
+    latencies.append(latency);
+    if (latencies.count() > 32)
+        latencies.removeFirst();
+}
+
+// Returns the provider with the lowest median answer time which was not asked yet
+int DevicePluginNetworkInfo::nextProvider() const
+{
+    int next = -1;
+    qint64 nextLatency = 0;
+    for (int i = 0; i < m_providers.count(); i++) {
+        if (m_askedProviders.contains(i))
+            continue;
+
+        qint64 latency = providerLatency(m_providers.at(i), 50);
+        if (next < 0 || latency < nextLatency) {
+            next = i;
+            nextLatency = latency;
+        }
+    }
+    return next;
+}
+
+bool DevicePluginNetworkInfo::sendLocationRequest()
+{
+    int index = nextProvider();
+    if (index < 0)
+        return false;
+
+    const LocationProvider &provider = m_providers.at(index);
+    qCDebug(dcNetworkInfo) << "Request location from" << provider.name;
+
+    // Create a network request
+    QNetworkRequest locationRequest(provider.url);
+
+    // Ask the server to answer only if the data changed since its last answer
+    if (index == m_locationProvider) {
+        if (!provider.entityTag.isEmpty())
+            locationRequest.setRawHeader("If-None-Match", provider.entityTag);
+
+        if (!provider.lastModified.isEmpty())
+            locationRequest.setRawHeader("If-Modified-Since", provider.lastModified);
     }
 
-    // print the fetched data in json format to stdout
-    qCDebug(dcNetworkInfo) << jsonDoc.toJson();
+    // Call the GET method from the NetworkManager
+    QNetworkReply *reply = networkManagerGet(locationRequest);
 
-    // Get the device for this action
-    Device *device = m_asyncActions.take(actionId);
+    LocationRequest request;
+    request.provider = index;
+    request.sentTime = m_clock.elapsed();
+    m_locationReplies.insert(reply, request);
+    m_askedProviders.append(index);
 
-    // Parse the data and update the states of our device
-    QVariantMap dataMap = jsonDoc.toVariant().toMap();
+    // Hedge to the next provider if this one is slower than usual
+    int percentile = configValue("hedge percentile").toInt();
+    if (percentile > 0 && nextProvider() >= 0) {
+        qint64 delay = configValue("hedge delay").toInt();
+        if (provider.latencies.count() >= 8)
+            delay = providerLatency(provider, percentile);
 
-    // Set the city state
-    if (dataMap.contains("city")) {
-        device->setStateValue(cityStateTypeId, dataMap.value("city").toString());
+        m_hedgeTimer->start(delay);
     }
 
-    // Set the country state
-    if (dataMap.contains("countryCode")) {
-        device->setStateValue(countryStateTypeId, dataMap.value("countryCode").toString());
+    return true;
+}
+
+void DevicePluginNetworkInfo::cancelLocationRequests()
+{
+    // Aborting finishes the replies, networkManagerReplyReady deletes them
+    QList<QNetworkReply *> replies = m_locationReplies.keys();
+    m_locationReplies.clear();
+    m_abortedReplies.append(replies);
+
+    foreach (QNetworkReply *reply, replies) {
+        qCDebug(dcNetworkInfo) << "Cancel location request to" << reply->url().toString();
+        reply->abort();
     }
+}
+
+void DevicePluginNetworkInfo::onHedgeTimeout()
+{
+    if (m_locationReplies.isEmpty())
+        return;
+
+    qCDebug(dcNetworkInfo) << "Location request takes too long, asking the next provider";
+    sendLocationRequest();
+}
 
-    // Set the wan ip
-    if (dataMap.contains("query")) {
-        device->setStateValue(addressStateTypeId, dataMap.value("query").toString());
+bool DevicePluginNetworkInfo::lookupLocation()
+{
+    if (!m_geoIpDatabase.isOpen())
+        return false;
+
+    // Without a configured WAN address use the one of the last remote answer. It may change
+    // at any time, so after its lifetime the remote request has to confirm it again.
+    QHostAddress address(configValue("wan address").toString());
+    if (address.isNull() && m_wanAddressAge.isValid()
+            && m_wanAddressAge.elapsed() < configValue("wan address lifetime").toLongLong() * 1000)
+        address = m_wanAddress;
+
+    if (address.isNull())
+        return false;
+
+    QList<JsonStateMapper::StateValue> states;
+    if (!m_geoIpDatabase.lookup(address, &states)) {
+        qCDebug(dcNetworkInfo) << "Address" << address.toString() << "not found in the GeoIP database";
+        return false;
     }
 
-    // Set the time zone state
-    if (dataMap.contains("timezone")) {
-        device->setStateValue(timeZoneStateTypeId, dataMap.value("timezone").toString());
+    // The current data is not the answer of a provider any more, so no conditional request can be sent
+    m_locationStates = states;
+    m_upToDateDevices.clear();
+    m_locationProvider = -1;
+    return true;
+}
+
+// Returns false if no request could be sent
+bool DevicePluginNetworkInfo::requestLocation()
+{
+    if (!m_locationReplies.isEmpty())
+        return true;
+
+    updateProviders();
+    m_askedProviders.clear();
+
+    if (!sendLocationRequest()) {
+        qCWarning(dcNetworkInfo) << "No location provider configured";
+        return false;
     }
+    return true;
+}
 
-    // Set the longitude state
-    if (dataMap.contains("lon")) {
-        device->setStateValue(lonStateTypeId, dataMap.value("lon").toDouble());
+bool DevicePluginNetworkInfo::locationDataValid() const
+{
+    if (!m_locationDataAge.isValid())
+        return false;
+
+    return m_locationDataAge.elapsed() < configValue("cache lifetime").toLongLong() * 1000;
+}
+
+void DevicePluginNetworkInfo::setLocationStates(Device *device)
+{
+    // This device has the current states already
+    if (m_upToDateDevices.contains(device))
+        return;
+
+    // The states are mapped with "sourceField" in the plugin JSON file. Unchanged values
+    // are ignored by the device, they don't cause a notification.
+    foreach (const JsonStateMapper::StateValue &state, m_locationStates) {
+        device->setStateValue(state.stateTypeId, state.value);
     }
 
-    // Set the latitude state
-    if (dataMap.contains("lat")) {
-        device->setStateValue(latStateTypeId, dataMap.value("lat").toDouble());
+    m_upToDateDevices.append(device);
+}
+
+void DevicePluginNetworkInfo::finishAsyncActions(DeviceManager::DeviceError error)
+{
+    // Take all waiting actions and refreshes, so none of them stays in the lists
+    QHash<ActionId, Device *> actions = m_asyncActions;
+    m_asyncActions.clear();
+
+    QList<Device *> refreshingDevices = m_refreshingDevices;
+    m_refreshingDevices.clear();
+
+    QHash<ActionId, Device *>::const_iterator it;
+    for (it = actions.constBegin(); it != actions.constEnd(); ++it) {
+        if (error == DeviceManager::DeviceErrorNoError) {
+            setLocationStates(it.value());
+            qCDebug(dcNetworkInfo) << "Action" << it.key() << "execution finished successfully.";
+        }
+
+        emit actionExecutionFinished(it.key(), error);
     }
 
-    qCDebug(dcNetworkInfo) << "Action" << actionId << "execution finished successfully.";
+    if (error != DeviceManager::DeviceErrorNoError) {
+        if (!refreshingDevices.isEmpty())
+            qCWarning(dcNetworkInfo) << "Could not refresh" << refreshingDevices.count() << "devices";
+
+        return;
+    }
 
-    // Emit the successfull action execution result to the device manager
-    emit actionExecutionFinished(actionId, DeviceManager::DeviceErrorNoError);
+    foreach (Device *device, refreshingDevices) {
+        setLocationStates(device);
+    }
 }
 
+bool DevicePluginNetworkInfo::locationDataReady(const QByteArray &data, const QHash<QByteArray, StateField> &fields)
+{
+    // print the fetched data to stdout
+    qCDebug(dcNetworkInfo) << data;
+
+    // Pick the mapped fields out of the rawdata
+    QList<JsonStateMapper::StateValue> states;
+    QString errorString;
+    if (!JsonStateMapper::map(data, fields, &states, &errorString)) {
+        qCWarning(dcNetworkInfo) << "Failed to parse JSON data" << data << ":" << errorString;
+        return false;
+    }
+
+    // Remember the WAN address for the local lookups
+    foreach (const JsonStateMapper::StateValue &state, states) {
+        if (state.stateTypeId == addressStateTypeId) {
+            m_wanAddress = QHostAddress(state.value.toString());
+            m_wanAddressAge.start();
+        }
+    }
+
+    // Remember the states for the following updates, all devices have to be updated again
+    m_locationStates = states;
+    m_locationDataAge.start();
+    m_upToDateDevices.clear();
+    return true;
+}
@@ -23,9 +23,17 @@
 
 #include "devicemanager.h"
 #include "plugin/deviceplugin.h"
+#include "plugintables.h"
+#include "jsonstatemapper.h"
+#include "geoipdatabase.h"
+#include "statesnapshot.h"
 
 #include <QHash>
 #include <QNetworkReply>
+#include <QElapsedTimer>
+#include <QHostAddress>
+
+#include <random>
 
 class DevicePluginNetworkInfo : public DevicePlugin
 {
@@ -39,16 +47,90 @@ public:
 
     DeviceManager::HardwareResources requiredHardware() const override;
     DeviceManager::DeviceSetupStatus setupDevice(Device *device) override;
+    void deviceRemoved(Device *device) override;
+
+    void guhTimer() override;
 
     void networkManagerReplyReady(QNetworkReply *reply) override;
 
     DeviceManager::DeviceError executeAction(Device *device, const Action &action) override;
 
 private:
+    // The action handlers, called by executeAction through the generated ActionDispatch table
+    friend class ActionDispatch<DevicePluginNetworkInfo>;
+
+    DeviceManager::DeviceError executeUpdate(Device *device, const Action &action);
+
+    struct LocationProvider {
+        QString name;
+        QUrl url;
+        QList<qint64> latencies;
+        QByteArray entityTag;
+        QByteArray lastModified;
+    };
+
+    struct LocationRequest {
+        int provider;
+        qint64 sentTime;
+    };
+
+    // The configured providers, the fastest one is asked first
+    QString m_providerConfig;
+    QList<LocationProvider> m_providers;
+    int m_locationProvider;
+
+    // All update actions and refreshes wait for the same location request. If it takes
+    // too long the request is hedged to the next provider and the first answer wins.
+    QHash<QNetworkReply *, LocationRequest> m_locationReplies;
+    QList<QNetworkReply *> m_abortedReplies;
+    QList<int> m_askedProviders;
+    QTimer *m_hedgeTimer;
+
     QHash <ActionId, Device *> m_asyncActions;
-    QHash <QNetworkReply *, ActionId> m_asyncActionReplies;
+    QList<Device *> m_refreshingDevices;
+
+    // The last location answer, valid for the configured cache lifetime
+    QList<JsonStateMapper::StateValue> m_locationStates;
+    QElapsedTimer m_locationDataAge;
+    QList<Device *> m_upToDateDevices;
+
+    // The last states of the devices, restored right after a restart
+    StateSnapshot *m_stateSnapshot;
+
+    // Local lookup of the WAN address, the remote request is the fallback. The address
+    // learned from a remote answer is used for the configured wan address lifetime.
+    GeoIpDatabase m_geoIpDatabase;
+    QHostAddress m_wanAddress;
+    QElapsedTimer m_wanAddressAge;
+
+    // Time of the next periodic refresh for each device, the jitter generator is seeded
+    // from the system so the gateways don't share the jitter sequence
+    QElapsedTimer m_clock;
+    QHash<Device *, qint64> m_nextRefresh;
+    std::mt19937_64 m_random;
+
+    qint64 refreshInterval() const;
+    qint64 refreshPhase(Device *device, qint64 interval) const;
+    qint64 refreshJitter(qint64 range);
+    void refreshDevice(Device *device);
+
+    void updateProviders();
+    qint64 providerLatency(const LocationProvider &provider, int percentile) const;
+    void addProviderLatency(int provider, qint64 latency);
+    int nextProvider() const;
+    bool sendLocationRequest();
+    void cancelLocationRequests();
+
+    bool lookupLocation();
+    bool requestLocation();
+    bool locationDataValid() const;
+    void setLocationStates(Device *device);
+    void finishAsyncActions(DeviceManager::DeviceError error);
+
+    bool locationDataReady(const QByteArray &data, const QHash<QByteArray, StateField> &fields);
 
-    void actionDataReady(const ActionId &actionId, const QByteArray &data);
+private slots:
+    void onHedgeTimeout();
 };
 
 #endif // DEVICEPLUGINNETWORKINFO_H
@@ -0,0 +1,148 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "geoipdatabase.h"
+#include "extern-plugininfo.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+static const int headerSize = 16;
+static const int rangeSize = 24;
+static const quint32 databaseVersion = 1;
+
+GeoIpDatabase::GeoIpDatabase() :
+    m_starts(0),
+    m_ranges(0),
+    m_strings(0),
+    m_count(0),
+    m_stringsSize(0)
+{
+}
+
+GeoIpDatabase::~GeoIpDatabase()
+{
+    close();
+}
+
+bool GeoIpDatabase::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qCWarning(dcNetworkInfo) << "Could not open GeoIP database" << fileName << m_file.errorString();
+        return false;
+    }
+
+    qint64 size = m_file.size();
+    const uchar *data = size >= headerSize ? m_file.map(0, size) : 0;
+    if (!data || memcmp(data, "GEOI", 4) != 0) {
+        qCWarning(dcNetworkInfo) << "Could not map GeoIP database" << fileName;
+        close();
+        return false;
+    }
+
+    quint32 version = qFromLittleEndian<quint32>(data + 4);
+    if (version != databaseVersion) {
+        qCWarning(dcNetworkInfo) << "Ignoring GeoIP database with unknown version" << version;
+        close();
+        return false;
+    }
+
+    m_count = qFromLittleEndian<quint32>(data + 8);
+    m_stringsSize = qFromLittleEndian<quint32>(data + 12);
+    if (size != headerSize + qint64(m_count) * (4 + rangeSize) + m_stringsSize) {
+        qCWarning(dcNetworkInfo) << "GeoIP database" << fileName << "is corrupt";
+        close();
+        return false;
+    }
+
+    m_starts = data + headerSize;
+    m_ranges = m_starts + m_count * 4;
+    m_strings = m_ranges + m_count * rangeSize;
+
+    qCDebug(dcNetworkInfo) << "Opened GeoIP database" << fileName << "with" << m_count << "ranges";
+    return true;
+}
+
+void GeoIpDatabase::close()
+{
+    // Closing the file unmaps the data
+    m_file.close();
+    m_starts = 0;
+    m_ranges = 0;
+    m_strings = 0;
+    m_count = 0;
+    m_stringsSize = 0;
+}
+
+bool GeoIpDatabase::isOpen() const
+{
+    return m_starts != 0;
+}
+
+QString GeoIpDatabase::fileName() const
+{
+    return m_file.fileName();
+}
+
+bool GeoIpDatabase::lookup(const QHostAddress &address, QList<JsonStateMapper::StateValue> *states) const
+{
+    bool ok = false;
+    quint32 ip = address.toIPv4Address(&ok);
+    if (!ok || m_count == 0)
+        return false;
+
+    // Find the last range starting at or before the address. The loop always runs
+    // log2(count) times and the compare compiles to a conditional move.
+    quint32 index = 0;
+    quint32 count = m_count;
+    while (count > 1) {
+        quint32 half = count / 2;
+        index = qFromLittleEndian<quint32>(m_starts + (index + half) * 4) <= ip ? index + half : index;
+        count -= half;
+    }
+
+    const uchar *range = m_ranges + index * rangeSize;
+    if (qFromLittleEndian<quint32>(m_starts + index * 4) > ip || qFromLittleEndian<quint32>(range) < ip)
+        return false;
+
+    states->append(JsonStateMapper::StateValue{addressStateTypeId, address.toString()});
+    states->append(JsonStateMapper::StateValue{cityStateTypeId, string(qFromLittleEndian<quint32>(range + 4))});
+    states->append(JsonStateMapper::StateValue{countryStateTypeId, string(qFromLittleEndian<quint32>(range + 8))});
+    states->append(JsonStateMapper::StateValue{timeZoneStateTypeId, string(qFromLittleEndian<quint32>(range + 12))});
+    states->append(JsonStateMapper::StateValue{latStateTypeId, qFromLittleEndian<qint32>(range + 16) / 1e6});
+    states->append(JsonStateMapper::StateValue{lonStateTypeId, qFromLittleEndian<qint32>(range + 20) / 1e6});
+    return true;
+}
+
+QString GeoIpDatabase::string(quint32 offset) const
+{
+    if (offset >= m_stringsSize)
+        return QString();
+
+    quint32 length = m_strings[offset];
+    if (offset + 1 + length > m_stringsSize)
+        return QString();
+
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_strings + offset + 1), length);
+}
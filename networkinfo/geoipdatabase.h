@@ -0,0 +1,64 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>                *
+ *                                                                         *
+ *  This file is part of guh.                                              *
+ *                                                                         *
+ *  Guh is free software: you can redistribute it and/or modify            *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  Guh is distributed in the hope that it will be useful,                 *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the           *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with guh. If not, see <http://www.gnu.org/licenses/>.            *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef GEOIPDATABASE_H
+#define GEOIPDATABASE_H
+
+#include "jsonstatemapper.h"
+
+#include <QFile>
+#include <QHostAddress>
+
+// Memory mapped IPv4 range database, created with tools/generategeoipdatabase.py
+//
+// Layout (little endian):
+//   header   "GEOI", quint32 version, quint32 range count, quint32 string table size
+//   starts   quint32 first address of each range, sorted
+//   ranges   quint32 last address, quint32 city, country and time zone string
+//            offsets, qint32 latitude and longitude in micro degrees
+//   strings  quint8 length followed by the UTF-8 bytes
+class GeoIpDatabase
+{
+public:
+    GeoIpDatabase();
+    ~GeoIpDatabase();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool isOpen() const;
+    QString fileName() const;
+
+    bool lookup(const QHostAddress &address, QList<JsonStateMapper::StateValue> *states) const;
+
+private:
+    QFile m_file;
+    const uchar *m_starts;
+    const uchar *m_ranges;
+    const uchar *m_strings;
+    quint32 m_count;
+    quint32 m_stringsSize;
+
+    QString string(quint32 offset) const;
+
+    Q_DISABLE_COPY(GeoIpDatabase)
+};
+
+#endif // GEOIPDATABASE_H
@@ -6,8 +6,16 @@ message(============================================)
 message("Qt version: $$[QT_VERSION]")
 message("Building $$deviceplugin$${TARGET}.so")
 
+INCLUDEPATH += ../common
+
 SOURCES += \
     devicepluginnetworkinfo.cpp \
+    geoipdatabase.cpp \
+    ../common/jsonstatemapper.cpp \
+    ../common/statesnapshot.cpp \
 
 HEADERS += \
     devicepluginnetworkinfo.h \
+    geoipdatabase.h \
+    ../common/jsonstatemapper.h \
+    ../common/statesnapshot.h \
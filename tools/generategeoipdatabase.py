@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>
+#
+# This file is part of guh.
+#
+# Guh is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 2 of the License.
+#
+# Guh is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with guh. If not, see <http://www.gnu.org/licenses/>.
+
+# Creates the GeoIP database of the NetworkInfo plugin (see
+# networkinfo/geoipdatabase.h) from a CSV file.
+#
+# Usage: generategeoipdatabase.py <csv file> <database file>
+#
+# Each CSV line describes one IPv4 range:
+#   first address, last address, country code, city, time zone, latitude, longitude
+
+import csv
+import ipaddress
+import struct
+import sys
+
+VERSION = 1
+
+
+def address(text):
+    text = text.strip()
+    if text.isdigit():
+        return int(text)
+    return int(ipaddress.IPv4Address(text))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('Usage: %s <csv file> <database file>' % sys.argv[0])
+
+    ranges = []
+    with open(sys.argv[1], newline='') as csv_file:
+        for row in csv.reader(csv_file):
+            if not row or row[0].startswith('#'):
+                continue
+            if len(row) != 7:
+                sys.exit('%s: expected 7 columns, got %d: %s' % (sys.argv[1], len(row), row))
+            first, last = address(row[0]), address(row[1])
+            if first > last:
+                sys.exit('%s: invalid range %s - %s' % (sys.argv[1], row[0], row[1]))
+            ranges.append((first, last, row[2].strip(), row[3].strip(), row[4].strip(), float(row[5]), float(row[6])))
+
+    ranges.sort()
+    for previous, current in zip(ranges, ranges[1:]):
+        if current[0] <= previous[1]:
+            sys.exit('%s: overlapping ranges starting at %s and %s' % (sys.argv[1], ipaddress.IPv4Address(previous[0]), ipaddress.IPv4Address(current[0])))
+
+    # Each distinct string is stored once
+    strings = bytearray()
+    offsets = {}
+
+    def string_offset(text):
+        if text not in offsets:
+            data = text.encode('utf-8')
+            if len(data) > 255:
+                sys.exit('%s: string too long: %s' % (sys.argv[1], text))
+            offsets[text] = len(strings)
+            strings.append(len(data))
+            strings.extend(data)
+        return offsets[text]
+
+    starts = bytearray()
+    records = bytearray()
+    for first, last, country, city, time_zone, lat, lon in ranges:
+        starts += struct.pack('<I', first)
+        records += struct.pack('<IIIIii', last, string_offset(city), string_offset(country), string_offset(time_zone), round(lat * 1e6), round(lon * 1e6))
+
+    with open(sys.argv[2], 'wb') as database:
+        database.write(b'GEOI' + struct.pack('<III', VERSION, len(ranges), len(strings)))
+        database.write(starts)
+        database.write(records)
+        database.write(strings)
+
+
+if __name__ == '__main__':
+    main()
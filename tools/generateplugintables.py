@@ -0,0 +1,348 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2016 Simon Stuerz <simon.stuerz@guh.guru>
+#
+# This file is part of guh.
+#
+# Guh is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 2 of the License.
+#
+# Guh is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with guh. If not, see <http://www.gnu.org/licenses/>.
+
+# Generates lookup tables from the plugin JSON file, next to the plugininfo.h
+# created by guh-generateplugininfo.
+#
+# Usage: generateplugintables.py <plugin json file> <output header>
+#
+# State fields: every stateType with a "sourceField" gets an entry in the
+# <deviceClassIdName>StateFields() table, which maps the name of the field in
+# the data the device sends to the StateTypeId and value type of the state.
+#
+# Provider fields: a stateType may name the field per data provider with
+# "providerFields": {"<provider>": "<field>"}. For each provider a
+# <deviceClassIdName>ProviderStateFields() table is created. It uses the
+# "sourceField" of the states the provider has no own field for.
+#
+# Action dispatch: ActionDispatch<Plugin>::handler() maps a (DeviceClassId,
+# ActionTypeId) pair to the execute<ActionTypeIdName>() member function of the
+# plugin class. Writable states are actions too. The lookup is a perfect hash,
+# the hash seed is searched by this script, so every pair has its own slot.
+#
+# Params: every ActionType with params gets a <ActionTypeIdName>Params struct
+# and every DeviceClass with params a <DeviceClassIdName>DeviceParams struct,
+# with one typed member per ParamType. Each member is read at the index of
+# its ParamType after one compare of the name, the list is only searched if
+# it has a different layout.
+
+import json
+import os
+import sys
+import uuid
+
+VARIANT_TYPES = {
+    'bool': 'QVariant::Bool',
+    'int': 'QVariant::Int',
+    'uint': 'QVariant::UInt',
+    'double': 'QVariant::Double',
+    'QString': 'QVariant::String',
+    'QColor': 'QVariant::Color',
+}
+
+
+def device_classes(plugin):
+    for vendor in plugin.get('vendors', []):
+        for device_class in vendor.get('deviceClasses', []):
+            yield device_class
+
+
+def upper_first(name):
+    return name[0].upper() + name[1:]
+
+
+def state_field(state, field):
+    if state['type'] not in VARIANT_TYPES:
+        sys.exit('%s: unsupported state type "%s" for source field "%s"' % (sys.argv[1], state['type'], field))
+    return 'StateField{%sStateTypeId, %s}' % (state['idName'], VARIANT_TYPES[state['type']])
+
+
+def write_state_fields(out, device_class):
+    fields = [state for state in device_class.get('stateTypes', []) if 'sourceField' in state]
+    if not fields:
+        return
+
+    name = device_class['idName']
+    out.append('// Source field -> state of the device class "%s"' % device_class['name'])
+    out.append('inline QHash<QByteArray, StateField> create%sStateFields()' % upper_first(name))
+    out.append('{')
+    out.append('    QHash<QByteArray, StateField> fields;')
+    for state in fields:
+        out.append('    fields.insert("%s", %s);' % (state['sourceField'], state_field(state, state['sourceField'])))
+    out.append('    return fields;')
+    out.append('}')
+    out.append('')
+    out.append('inline const QHash<QByteArray, StateField> &%sStateFields()' % name)
+    out.append('{')
+    out.append('    static const QHash<QByteArray, StateField> fields = create%sStateFields();' % upper_first(name))
+    out.append('    return fields;')
+    out.append('}')
+    out.append('')
+
+
+def write_provider_state_fields(out, device_class):
+    states = device_class.get('stateTypes', [])
+    providers = []
+    for state in states:
+        for provider in state.get('providerFields', {}):
+            if provider not in providers:
+                providers.append(provider)
+    if not providers:
+        return
+
+    name = device_class['idName']
+    out.append('// Provider -> source field -> state of the device class "%s"' % device_class['name'])
+    out.append('inline QHash<QString, QHash<QByteArray, StateField> > create%sProviderStateFields()' % upper_first(name))
+    out.append('{')
+    out.append('    QHash<QString, QHash<QByteArray, StateField> > providers;')
+    for provider in providers:
+        for state in states:
+            field = state.get('providerFields', {}).get(provider, state.get('sourceField'))
+            if field:
+                out.append('    providers["%s"].insert("%s", %s);' % (provider, field, state_field(state, field)))
+    out.append('    return providers;')
+    out.append('}')
+    out.append('')
+    out.append('inline const QHash<QString, QHash<QByteArray, StateField> > &%sProviderStateFields()' % name)
+    out.append('{')
+    out.append('    static const QHash<QString, QHash<QByteArray, StateField> > providers = create%sProviderStateFields();' % upper_first(name))
+    out.append('    return providers;')
+    out.append('}')
+    out.append('')
+
+
+CPP_TYPES = {
+    'bool': 'bool',
+    'int': 'int',
+    'uint': 'uint',
+    'double': 'double',
+    'QString': 'QString',
+    'QColor': 'QColor',
+}
+
+
+def member_name(name):
+    words = [word for word in ''.join(c if c.isalnum() else ' ' for c in name).split()]
+    return words[0][0].lower() + words[0][1:] + ''.join(upper_first(word) for word in words[1:])
+
+
+def write_params_struct(out, struct_name, description, param_types, source_type, source_name, source_params):
+    out.append('// Params of %s' % description)
+    out.append('struct %s {' % struct_name)
+    for param_type in param_types:
+        if param_type['type'] not in CPP_TYPES:
+            sys.exit('%s: unsupported param type "%s" of "%s"' % (sys.argv[1], param_type['type'], param_type['name']))
+        out.append('    %s %s;' % (CPP_TYPES[param_type['type']], member_name(param_type['name'])))
+    out.append('')
+    out.append('    static %s from%s(%s%s)' % (struct_name, upper_first(source_name), source_type, source_name))
+    out.append('    {')
+    out.append('        const ParamList params = %s;' % source_params)
+    out.append('        %s result;' % struct_name)
+    for index, param_type in enumerate(param_types):
+        out.append('        result.%s = indexedParamValue(params, %d, QLatin1String("%s")).value<%s>();' % (member_name(param_type['name']), index, param_type['name'], CPP_TYPES[param_type['type']]))
+    out.append('        return result;')
+    out.append('    }')
+    out.append('};')
+    out.append('')
+
+
+def write_params(out, plugin):
+    structs = []
+    for device_class in device_classes(plugin):
+        if device_class.get('paramTypes'):
+            structs.append(('%sDeviceParams' % upper_first(device_class['idName']), 'the device class "%s"' % device_class['name'],
+                            device_class['paramTypes'], 'Device *', 'device', 'device->params()'))
+    for device_class, action in plugin_actions(plugin):
+        # The action of a writable state has the state as its only param
+        param_types = action.get('paramTypes', []) if 'paramTypes' in action or not action.get('writable') else [action]
+        if param_types:
+            structs.append(('%sParams' % upper_first(action['idName']), 'the action "%s" of "%s"' % (action['name'], device_class['name']),
+                            param_types, 'const Action &', 'action', 'action.params()'))
+    if not structs:
+        return
+
+    out.append('// Value of the param at the index of its ParamType, falls back to a search by name')
+    out.append('inline QVariant indexedParamValue(const ParamList &params, int index, const QLatin1String &name)')
+    out.append('{')
+    out.append('    if (index < params.count() && params.at(index).name() == name)')
+    out.append('        return params.at(index).value();')
+    out.append('')
+    out.append('    foreach (const Param &param, params) {')
+    out.append('        if (param.name() == name)')
+    out.append('            return param.value();')
+    out.append('    }')
+    out.append('    return QVariant();')
+    out.append('}')
+    out.append('')
+    for struct in structs:
+        write_params_struct(out, *struct)
+
+
+HASH_MULTIPLIER = 0x9e3779b97f4a7c15
+MASK64 = (1 << 64) - 1
+
+
+def uuid_key(text):
+    # The two 64 bit halves of a QUuid: data1, data2, data3 and data4
+    value = uuid.UUID(text).int
+    return value >> 64, value & MASK64
+
+
+def dispatch_slot(key, seed, bits):
+    mixed = (key[0] ^ key[1] ^ (((key[2] ^ key[3]) * HASH_MULTIPLIER) & MASK64)) & MASK64
+    return ((mixed * seed) & MASK64) >> (64 - bits)
+
+
+def find_dispatch_seed(keys):
+    bits = 1
+    while (1 << bits) < len(keys):
+        bits += 1
+    while True:
+        for attempt in range(1, 100000):
+            seed = (attempt * HASH_MULTIPLIER) & MASK64 | 1
+            if len(set(dispatch_slot(key, seed, bits) for key in keys)) == len(keys):
+                return seed, bits
+        bits += 1
+
+
+def plugin_actions(plugin):
+    for device_class in device_classes(plugin):
+        for action in device_class.get('actionTypes', []):
+            yield device_class, action
+        for state in device_class.get('stateTypes', []):
+            if state.get('writable'):
+                yield device_class, state
+
+
+def write_action_dispatch(out, plugin):
+    actions = list(plugin_actions(plugin))
+    if not actions:
+        return
+
+    entries = []
+    for device_class, action in actions:
+        key = uuid_key(device_class['deviceClassId']) + uuid_key(action['id'])
+        entries.append((key, 'execute' + upper_first(action['idName'])))
+
+    seed, bits = find_dispatch_seed([key for key, handler in entries])
+    table = [None] * (1 << bits)
+    for key, handler in entries:
+        table[dispatch_slot(key, seed, bits)] = (key, handler)
+
+    out.append('// (DeviceClassId, ActionTypeId) -> execute<ActionType>() member function of the plugin')
+    out.append('template <typename Plugin>')
+    out.append('class ActionDispatch')
+    out.append('{')
+    out.append('public:')
+    out.append('    typedef DeviceManager::DeviceError (Plugin::*Handler)(Device *device, const Action &action);')
+    out.append('')
+    out.append('    static bool containsDeviceClass(const DeviceClassId &deviceClassId)')
+    out.append('    {')
+    out.append('        return %s;' % ' || '.join('deviceClassId == %sDeviceClassId' % device_class['idName'] for device_class in device_classes(plugin)))
+    out.append('    }')
+    out.append('')
+    out.append('    static Handler handler(const DeviceClassId &deviceClassId, const ActionTypeId &actionTypeId)')
+    out.append('    {')
+    out.append('        static Q_DECL_CONSTEXPR Entry table[%d] = {' % len(table))
+    for entry in table:
+        if entry is None:
+            out.append('            { { 0, 0, 0, 0 }, 0 },')
+        else:
+            key, handler = entry
+            out.append('            { { 0x%016xULL, 0x%016xULL, 0x%016xULL, 0x%016xULL }, &Plugin::%s },' % (key + (handler,)))
+    out.append('        };')
+    out.append('')
+    out.append('        const quint64 key[4] = { high(deviceClassId), low(deviceClassId), high(actionTypeId), low(actionTypeId) };')
+    out.append('        const Entry &entry = table[slot(key[0], key[1], key[2], key[3])];')
+    out.append('        if (entry.key[0] != key[0] || entry.key[1] != key[1] || entry.key[2] != key[2] || entry.key[3] != key[3])')
+    out.append('            return 0;')
+    out.append('')
+    out.append('        return entry.handler;')
+    out.append('    }')
+    out.append('')
+    out.append('private:')
+    out.append('    struct Entry {')
+    out.append('        quint64 key[4];')
+    out.append('        Handler handler;')
+    out.append('    };')
+    out.append('')
+    out.append('    static Q_DECL_CONSTEXPR int slot(quint64 deviceClassHigh, quint64 deviceClassLow, quint64 actionTypeHigh, quint64 actionTypeLow)')
+    out.append('    {')
+    out.append('        return int(((deviceClassHigh ^ deviceClassLow ^ ((actionTypeHigh ^ actionTypeLow) * 0x%016xULL)) * 0x%016xULL) >> %d);' % (HASH_MULTIPLIER, seed, 64 - bits))
+    out.append('    }')
+    out.append('')
+    out.append('    static quint64 high(const QUuid &uuid)')
+    out.append('    {')
+    out.append('        return (quint64(uuid.data1) << 32) | (quint64(uuid.data2) << 16) | uuid.data3;')
+    out.append('    }')
+    out.append('')
+    out.append('    static quint64 low(const QUuid &uuid)')
+    out.append('    {')
+    out.append('        quint64 low = 0;')
+    out.append('        for (int i = 0; i < 8; i++)')
+    out.append('            low = (low << 8) | uuid.data4[i];')
+    out.append('        return low;')
+    out.append('    }')
+    out.append('};')
+    out.append('')
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('Usage: %s <plugin json file> <output header>' % sys.argv[0])
+
+    with open(sys.argv[1]) as json_file:
+        plugin = json.load(json_file)
+
+    out = []
+    out.append('/* This file is generated by %s from %s, do not edit. */' % (os.path.basename(sys.argv[0]), os.path.basename(sys.argv[1])))
+    out.append('')
+    out.append('#ifndef PLUGINTABLES_H')
+    out.append('#define PLUGINTABLES_H')
+    out.append('')
+    out.append('#include "extern-plugininfo.h"')
+    out.append('#include "devicemanager.h"')
+    out.append('')
+    out.append('#include <QHash>')
+    out.append('#include <QByteArray>')
+    out.append('#include <QString>')
+    out.append('#include <QVariant>')
+    out.append('#include <QUuid>')
+    out.append('#include <QColor>')
+    out.append('')
+    out.append('struct StateField {')
+    out.append('    StateTypeId stateTypeId;')
+    out.append('    QVariant::Type type;')
+    out.append('};')
+    out.append('')
+
+    for device_class in device_classes(plugin):
+        write_state_fields(out, device_class)
+        write_provider_state_fields(out, device_class)
+
+    write_action_dispatch(out, plugin)
+    write_params(out, plugin)
+
+    out.append('#endif // PLUGINTABLES_H')
+
+    with open(sys.argv[2], 'w') as header:
+        header.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()